@@ -0,0 +1,304 @@
+// ==========================================
+// MARKETPLACE MICRO-BENCHMARKS
+// ==========================================
+// Builds a synthetic marketplace (N sellers, customers and products, carts drawn from a Zipf
+// distribution) in a scratch directory and times the hot paths of final.cpp against it.
+//
+// Build: g++ -std=c++17 -O2 -pthread benchmark.cpp -o benchmark
+// Usage: benchmark [--sellers N] [--customers N] [--products N] [--min-time SECONDS] [name filter]
+//
+// Built with -DMARKETPLACE_METRICS, an "Allocs/op" column adds the heap allocations per operation
+// (the Metrics operator new counter, every thread included). Each Marketplace then also prints its
+// metrics report to stderr when it closes: run with 2>/dev/null to keep just the table.
+//
+// Note: Output follows Google Benchmark's table layout (name, time per operation, iterations),
+// but the harness is self-contained so the project still needs nothing beyond the standard library.
+
+#define MARKETPLACE_NO_MAIN
+#include "final.cpp"
+
+#include <filesystem>
+#include <random>
+#include <cmath>
+
+namespace {
+
+// ==========================================
+// 1. SYNTHETIC DATA
+// ==========================================
+
+struct BenchConfig {
+    int sellers = 10000;
+    int customers = 100000;
+    int products = 200000;
+    double minTime = 0.5; // Seconds each benchmark keeps repeating for
+    string filter;        // Only run benchmarks whose name contains this
+};
+
+const char* const CATEGORIES[] = {
+    "Electronics", "Accessories", "Books", "Clothing", "Home", "Kitchen", "Sports", "Toys",
+    "Beauty", "Garden", "Grocery", "Office", "Automotive", "Music", "Health", "Pets"
+};
+const char* const BRANDS[] = {
+    "Samsung", "Apple", "Sony", "HP", "Dell", "Lenovo", "Nike", "Adidas", "Philips", "Bosch",
+    "Canon", "Xiaomi", "Huawei", "LG", "Panasonic", "Asus"
+};
+const char* const ITEMS[] = {
+    "Phone", "Laptop", "Speaker", "Headphones", "Watch", "Camera", "Charger", "Mouse", "Keyboard",
+    "Monitor", "Shoes", "Jacket", "Blender", "Kettle", "Lamp", "Backpack", "Tablet", "Router"
+};
+template <typename T, size_t N> constexpr int countOf(T (&)[N]) { return N; }
+
+// Zipf over ranks [0, n): rank 0 is the most popular, rank i is drawn with weight 1 / (i + 1)^skew
+// Logic: Inverse CDF: a uniform draw is binary-searched in the cumulative weights, O(log n) per sample.
+class Zipf {
+private:
+    vector<double> cdf;
+public:
+    explicit Zipf(int n, double skew = 1.0) : cdf(n) {
+        double sum = 0;
+        for (int i = 0; i < n; i++) cdf[i] = (sum += 1.0 / pow(i + 1, skew));
+        for (double& c : cdf) c /= sum;
+    }
+    int operator()(mt19937& rng) const {
+        double u = uniform_real_distribution<double>(0, 1)(rng);
+        return min(int(lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin()), int(cdf.size()) - 1);
+    }
+};
+
+string sellerEmail(int id) { return "seller" + to_string(id) + "@bench.test"; }
+string customerEmail(int id) { return "customer" + to_string(id) + "@bench.test"; }
+
+// Writes sellers.txt, customers.txt, products.txt and carts.txt into the current directory
+void generateData(const BenchConfig& cfg, const Zipf& popularity) {
+    mt19937 rng(12345); // Fixed seed: every run times the same data
+
+    ofstream sellers("sellers.txt");
+    for (int id = 1; id <= cfg.sellers; id++)
+        sellers << id << "|Seller " << id << "|" << sellerEmail(id) << "\n";
+
+    ofstream customers("customers.txt");
+    for (int id = 1; id <= cfg.customers; id++)
+        customers << id << "|Customer " << id << "|City " << id % 100 << "|010" << 10000000 + id
+                  << "|" << customerEmail(id) << "\n";
+
+    // Stock is large enough that no add-to-cart or checkout in a run ever runs out
+    // The last tenth of the catalog belongs to seller 1, a power seller whose SKUs came in as one import
+    ofstream products("products.txt");
+    int powerSellerFrom = cfg.products - cfg.products / 10;
+    for (int id = 1; id <= cfg.products; id++) {
+        int ratings = rng() % 50;
+        int seller = 1 + rng() % cfg.sellers;
+        products << id << "|" << BRANDS[rng() % countOf(BRANDS)] << " " << ITEMS[rng() % countOf(ITEMS)]
+                 << " " << id << "|" << 10 + rng() % 20000 << "|" << CATEGORIES[rng() % countOf(CATEGORIES)]
+                 << "|1000000000|" << (id > powerSellerFrom ? 1 : seller) << "|" << ratings * (1 + rng() % 5)
+                 << "|" << ratings << "\n";
+    }
+
+    // One customer in five has a cart of 1-5 lines; products are picked by Zipf popularity
+    ofstream carts("carts.txt");
+    for (int id = 1; id <= cfg.customers; id++) {
+        if (rng() % 5 != 0) continue;
+        int lines = 1 + rng() % 5;
+        for (int i = 0; i < lines; i++)
+            carts << id << "|" << 1 + popularity(rng) << "|" << 1 + rng() % 3 << "\n";
+    }
+}
+
+// BENCHMARK_NO_MAIN: lets another program (loadtest.cpp) reuse the synthetic data above without the benchmarks
+#ifndef BENCHMARK_NO_MAIN
+
+// ==========================================
+// 2. TIMING HARNESS
+// ==========================================
+
+volatile long long sink; // Results are folded in here so the optimizer cannot drop the work
+
+// Runs op() in growing batches until minTime has passed, then reports the mean time per call
+void runBenchmark(const BenchConfig& cfg, const string& name, const function<void()>& op) {
+    if (name.find(cfg.filter) == string::npos) return;
+    using Clock = chrono::steady_clock;
+    long long iterations = 0;
+    double elapsed = 0;
+#ifdef MARKETPLACE_METRICS
+    uint64_t allocations = Metrics::total(Metrics::ALLOCATIONS);
+#endif
+    for (long long batch = 1; elapsed < cfg.minTime; batch *= 2) {
+        auto start = Clock::now();
+        for (long long i = 0; i < batch; i++) op();
+        elapsed += chrono::duration<double>(Clock::now() - start).count();
+        iterations += batch;
+    }
+    double perOp = elapsed / iterations;
+    const char* unit = "ns";
+    double shown = perOp * 1e9;
+    if (shown >= 1e6) { shown /= 1e6; unit = "ms"; }
+    else if (shown >= 1e3) { shown /= 1e3; unit = "us"; }
+    cout << left << setw(32) << name << right << setw(12) << fixed << setprecision(1) << shown << " " << unit
+         << setw(14) << iterations;
+#ifdef MARKETPLACE_METRICS
+    cout << setw(14) << double(Metrics::total(Metrics::ALLOCATIONS) - allocations) / iterations;
+#endif
+    cout << endl;
+}
+
+// ==========================================
+// 3. BENCHMARKS
+// ==========================================
+
+void runAll(const BenchConfig& cfg) {
+    Zipf popularity(cfg.products);
+    generateData(cfg, popularity);
+    mt19937 rng(678);
+
+    cout << "Data: " << cfg.sellers << " sellers, " << cfg.customers << " customers, "
+         << cfg.products << " products\n";
+#ifdef MARKETPLACE_METRICS
+    const int width = 78;
+#else
+    const int width = 64;
+#endif
+    cout << string(width, '-') << "\n";
+    cout << left << setw(32) << "Benchmark" << right << setw(15) << "Time" << setw(14) << "Iterations";
+#ifdef MARKETPLACE_METRICS
+    cout << setw(14) << "Allocs/op";
+#endif
+    cout << "\n" << string(width, '-') << "\n";
+
+    // loadData (plus journal replay and cart reservations): one full startup per iteration
+    runBenchmark(cfg, "loadData", [] {
+        Marketplace m;
+        sink += m.findCustomer(1);
+    });
+
+    Marketplace m;
+
+    // Compaction in two halves: the point-in-time copy taken under the catalog lock, then the formatting
+    // the background writer does from it (the disk I/O is not timed)
+    // Note: Customer shards are only written when they have unsaved rows, so this is sellers and products
+    // plus the shards changed by earlier benchmarks (none, right after loading).
+    runBenchmark(cfg, "snapshot/capture_all_tables", [&] {
+        sink += m.captureSnapshot(Marketplace::ALL_TABLES)->products.size();
+    });
+    shared_ptr<const TableSnapshot> view = m.captureSnapshot(Marketplace::ALL_TABLES);
+    runBenchmark(cfg, "saveData/all_tables", [&] {
+        for (auto& file : Marketplace::saveData(*view)) sink += file.second.size();
+    });
+
+    // Login: the email lookup behind the customer login, including loading the customer's shard
+    // (random customers over more shards than stay resident, so most logins read one)
+    vector<string> emails;
+    for (int i = 0; i < 1024; i++) emails.push_back(customerEmail(1 + rng() % cfg.customers));
+    size_t nextEmail = 0;
+    runBenchmark(cfg, "login/customer_email", [&] {
+        sink += m.loadCustomerByEmail(emails[nextEmail++ % emails.size()]);
+    });
+
+    // Category filter: posting-list lookup plus the first screen ranked by rating
+    size_t nextCategory = 0;
+    runBenchmark(cfg, "filter/category_first_page", [&] {
+        vector<int> rows = m.productsInCategory(CATEGORIES[nextCategory++ % countOf(CATEGORIES)]);
+        sink += m.rankedPage(rows, 0, 10).size();
+    });
+
+    // The same filter as browse traffic repeats it: served from the result cache after the first miss
+    runBenchmark(cfg, "filter/category_cached", [&] {
+        sink += m.categoryListing(CATEGORIES[nextCategory++ % countOf(CATEGORIES)])->rows.size();
+    });
+
+    // Name search: substring and prefix queries through the trigram index
+    const char* const queries[] = { "phone", "sony lap", "speaker 1", "Apple*", "watch 99", "usb" };
+    size_t nextQuery = 0;
+    runBenchmark(cfg, "search/name", [&] {
+        sink += m.searchProducts(queries[nextQuery++ % countOf(queries)]).size();
+    });
+
+    // Advanced search: category AND price range AND rating, in stock, first screen by price
+    size_t nextRange = 0;
+    runBenchmark(cfg, "query/category_price_rating", [&] {
+        ProductQuery q;
+        q.category = CATEGORIES[nextRange % countOf(CATEGORIES)];
+        q.minPrice = 1000 * (nextRange++ % 10);
+        q.maxPrice = q.minPrice + 4000;
+        q.minRating = 3;
+        q.inStockOnly = true;
+        q.sort = ProductQuery::PRICE_LOW_HIGH;
+        vector<int> rows = m.queryProducts(q);
+        sink += m.queryPage(q.sort, rows, 0, 10).size();
+    });
+
+    // showTopRatedProducts: walking the first ten screens of the rating ranking
+    runBenchmark(cfg, "top_rated/ten_pages", [&] {
+        RatingIndex::Entry cursor = RatingIndex::start();
+        vector<int> rows;
+        for (int page = 0; page < 10; page++) {
+            rows.clear();
+            bool more = m.topRatedPage(cursor, rows);
+            sink += rows.size();
+            if (!more) break;
+        }
+    });
+
+    // Seller dashboard: totals over a typical seller's products, then over the power seller's (seller 1)
+    runBenchmark(cfg, "analytics/seller_typical", [&] {
+        ProductStore::Totals t = m.sellerTotals(rng() % cfg.sellers); // Positions follow the ids in sellers.txt
+        sink += t.products;
+    });
+    runBenchmark(cfg, "analytics/power_seller", [&] {
+        ProductStore::Totals t = m.sellerTotals(0); // Seller 1
+        sink += t.products + (long long)t.inventoryValue;
+    });
+
+    // Checkout: five Zipf-popular add-to-carts, then the full checkout (commit, journal, receipt, ratings)
+    string ratingInput;
+    for (int i = 0; i < 16; i++) ratingInput += "5\n";
+    ratingInput += "\n\n";
+    int nextCustomer = 0;
+    runBenchmark(cfg, "checkout/five_items", [&] {
+        istringstream in(ratingInput);
+        ostringstream out;
+        Session s{in, out, false};
+        s.customerIdx = m.batchCustomer(1 + nextCustomer++ % cfg.customers, out); // Loads its shard on first use
+        for (int i = 0; i < 5; i++) m.addToCart(s.customerIdx, 1 + popularity(rng), 1, out);
+        m.processCheckout(s);
+        m.maybeCompact(); // As the menus do between actions
+        sink += out.tellp();
+    });
+}
+
+#endif // BENCHMARK_NO_MAIN
+
+} // namespace
+
+#ifndef BENCHMARK_NO_MAIN
+int main(int argc, char* argv[]) {
+    BenchConfig cfg;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--sellers" && hasValue) cfg.sellers = max(1, atoi(argv[++i]));
+        else if (arg == "--customers" && hasValue) cfg.customers = max(1, atoi(argv[++i]));
+        else if (arg == "--products" && hasValue) cfg.products = max(1, atoi(argv[++i]));
+        else if (arg == "--min-time" && hasValue) cfg.minTime = atof(argv[++i]);
+        else if (!arg.empty() && arg[0] != '-') cfg.filter = arg;
+        else {
+            cerr << "Usage: " << argv[0] << " [--sellers N] [--customers N] [--products N]"
+                 << " [--min-time SECONDS] [name filter]\n";
+            return 1;
+        }
+    }
+
+    // Scratch directory: the marketplace reads and writes its files relative to the working directory
+    namespace fs = std::filesystem;
+    fs::path home = fs::current_path();
+    fs::path scratch = fs::temp_directory_path() / ("marketplace-bench-" + to_string(getpid()));
+    fs::create_directories(scratch);
+    fs::current_path(scratch);
+
+    runAll(cfg);
+
+    fs::current_path(home);
+    fs::remove_all(scratch);
+    return 0;
+}
+#endif
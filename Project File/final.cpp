@@ -2,17 +2,20 @@
  * PROJECT: Online Marketplace Management System
  * DESCRIPTION: A C++ console application for buying and selling products.
  * Demonstrates the practical use of Data Structures:
- * - Vectors (Database Storage)
- * - Stacks (Shopping Cart - LIFO)
+ * - Vectors (Database Storage; products are stored column by column)
+ * - Stacks (Shopping Cart - LIFO, stored as a contiguous vector)
  * - Queues (Checkout Process - FIFO)
- * - Priority Queues (Rating System - Max Heap)
+ * - Ordered Sets (Rating System - Balanced BST kept sorted by average rating)
+ * - Hash Maps (Lookup by ID / Email)
+ * - Inverted Index (Product Name Search by Trigram)
+ * - Interned Category Table (Category -> Product postings)
  *
  * FEATURES:
  * - Seller/Customer Login & Registration
  * - Product Inventory Management
  * - Shopping Cart with Undo functionality
  * - Order Processing & Receipt Generation
- * - Data Persistence via Text Files
+ * - Data Persistence via Text Files (or an optional binary snapshot)
  */
 
 #include <iostream>
@@ -22,11 +25,42 @@
 #include <iomanip>    // For tables and output formatting
 #include <fstream>    // For File I/O (Persistence)
 #include <sstream>    // For string manipulation
-#include <stack>      // DATA STRUCTURE: Stack (LIFO for Cart)
-#include <queue>      // DATA STRUCTURE: Queue (FIFO for Checkout) & Priority Queue (Sorting)
+#include <queue>      // DATA STRUCTURE: Queue (FIFO for Checkout)
+#include <set>        // DATA STRUCTURE: Ordered Set (Rating Ranking)
+#include <deque>      // Stable string storage for interned categories
+#include <unordered_map> // DATA STRUCTURE: Hash Map (O(1) lookup indexes)
+#include <list>       // DATA STRUCTURE: Linked List (LRU order of the result cache)
 #include <ctime>      // For Date/Time on receipt
 #include <cstdlib>    // For system("cls") or system("clear")
 #include <limits>     // For robust input clearing
+#include <functional> // For paginated listing callbacks
+#include <string_view> // For zero-copy field splitting
+#include <charconv>   // For from_chars (allocation-free number parsing)
+#include <cstring>    // For memchr
+#include <cctype>     // For tolower (case-insensitive search)
+#include <cstdint>    // For uint32_t (packed trigram keys, binary snapshot fields)
+#include <cstdio>     // For rename / remove (atomic snapshot replace)
+#include <thread>     // Background persistence thread
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <shared_mutex> // Catalog read/write lock (server mode)
+#include <atomic>
+#include <memory>       // For unique_ptr (server client list)
+#include <memory_resource> // For monotonic_buffer_resource (string arenas)
+#include <filesystem>   // For finding the customer shard files
+
+#ifndef _WIN32
+#include <fcntl.h>    // For open()
+#include <sys/mman.h> // For mmap() (Memory-Mapped Loading)
+#include <sys/stat.h> // For fstat()
+#include <unistd.h>   // For close() / fsync()
+#include <sys/socket.h> // Server mode (TCP sessions)
+#include <netinet/in.h>
+#include <poll.h>
+#include <csignal>
+#include <cerrno>
+#endif
 
 using namespace std;
 
@@ -34,13 +68,256 @@ using namespace std;
 // 1. DATA STRUCTURES & CLASSES
 // ==========================================
 
+// HOT-PATH INSTRUMENTATION (compiled in with -DMARKETPLACE_METRICS)
+// Scoped timers feed per-thread latency histograms; counters track allocations, bytes written,
+// index lookups and lock contention. Metrics::dump() merges every thread's numbers into one report.
+// Reason: Without the flag the METRIC_* macros expand to nothing, so normal builds pay nothing.
+#ifdef MARKETPLACE_METRICS
+struct Metrics {
+    enum Timer { LOAD_DATA, LOAD_SHARD, SAVE_DATA, COMPACT, JOURNAL_WRITE, SEARCH, CATEGORY_FILTER, QUERY, TOP_RATED, CHECKOUT, SELLER_ANALYTICS,
+                 CATALOG_WAIT, STRIPE_WAIT, RATING_WAIT, TIMER_COUNT };
+    enum Counter { ALLOCATIONS, ALLOCATED_BYTES, BYTES_WRITTEN, INDEX_HITS, INDEX_MISSES, CACHE_HITS, CACHE_MISSES,
+                   CATALOG_LOCKS, STRIPE_LOCKS, RATING_LOCKS, STOCK_RETRIES, COUNTER_COUNT };
+
+    // DATA STRUCTURE: LOG-LINEAR HISTOGRAM (HDR style)
+    // Logic: 16 buckets per power of two, so any latency from 1 ns to centuries is kept
+    // within 1/16 (~6%) of its value in a fixed 976-slot array.
+    static constexpr int SUB_BITS = 4, SUB = 1 << SUB_BITS, BUCKETS = (64 - SUB_BITS + 1) * SUB;
+
+    static int bucketOf(uint64_t v) {
+        if (v < SUB) return v;
+        int exp = 63 - __builtin_clzll(v);
+        return (exp - SUB_BITS + 1) * SUB + ((v >> (exp - SUB_BITS)) & (SUB - 1));
+    }
+
+    // Largest value that lands in bucket b
+    static uint64_t bucketTop(int b) {
+        if (b < SUB) return b;
+        int exp = b / SUB + SUB_BITS - 1;
+        return ((uint64_t(SUB + b % SUB + 1)) << (exp - SUB_BITS)) - 1;
+    }
+
+    // One thread's numbers. Only the owning thread writes, so updates need no atomic read-modify-write;
+    // they are atomics so dump() may read them from another thread.
+    // Note: No member initializers: Block() value-initializes to zeros, and static blocks start zeroed.
+    struct Block {
+        atomic<uint64_t> buckets[TIMER_COUNT][BUCKETS];
+        atomic<uint64_t> totalNs[TIMER_COUNT];
+        atomic<uint64_t> maxNs[TIMER_COUNT];
+        atomic<uint64_t> counters[COUNTER_COUNT];
+        Block* next;
+    };
+
+    static void bump(atomic<uint64_t>& a, uint64_t n) { a.store(a.load(memory_order_relaxed) + n, memory_order_relaxed); }
+
+    // Live blocks (a linked list, so registering never allocates: operator new below counts into it),
+    // and the totals of threads that have exited
+    static inline mutex registry;
+    static inline Block* live = nullptr;
+    static inline Block retired;
+    static inline thread_local Block* mine = nullptr;
+    static inline thread_local bool exited = false;
+
+    // Unregisters the thread's block at thread exit, folding its numbers into 'retired'
+    struct Owner {
+        ~Owner() {
+            lock_guard<mutex> guard(registry);
+            for (Block** at = &live; *at; at = &(*at)->next)
+                if (*at == mine) { *at = mine->next; break; }
+            merge(retired, *mine);
+            mine->~Block();
+            free(mine);
+            mine = nullptr;
+            exited = true;
+        }
+    };
+
+    static Block* block() {
+        if (mine != nullptr || exited) return mine;
+        void* raw = malloc(sizeof(Block)); // Not operator new: that would count (and recurse into) us
+        if (raw == nullptr) return nullptr;
+        Block* b = new (raw) Block();
+        {
+            lock_guard<mutex> guard(registry);
+            b->next = live;
+            live = b;
+        }
+        mine = b;
+        static thread_local Owner owner; // Its destructor runs at thread exit
+        return b;
+    }
+
+    static void merge(Block& into, const Block& from) {
+        for (int t = 0; t < TIMER_COUNT; t++) {
+            for (int b = 0; b < BUCKETS; b++) into.buckets[t][b].fetch_add(from.buckets[t][b].load(memory_order_relaxed), memory_order_relaxed);
+            into.totalNs[t].fetch_add(from.totalNs[t].load(memory_order_relaxed), memory_order_relaxed);
+            uint64_t m = from.maxNs[t].load(memory_order_relaxed);
+            if (m > into.maxNs[t].load(memory_order_relaxed)) into.maxNs[t].store(m, memory_order_relaxed);
+        }
+        for (int c = 0; c < COUNTER_COUNT; c++) into.counters[c].fetch_add(from.counters[c].load(memory_order_relaxed), memory_order_relaxed);
+    }
+
+    static void add(Counter c, uint64_t n) {
+        Block* b = block();
+        if (b != nullptr) bump(b->counters[c], n);
+        else retired.counters[c].fetch_add(n, memory_order_relaxed); // During thread exit
+    }
+
+    static void record(Timer t, uint64_t ns) {
+        Block* b = block();
+        if (b == nullptr) return;
+        bump(b->buckets[t][bucketOf(ns)], 1);
+        bump(b->totalNs[t], ns);
+        if (ns > b->maxNs[t].load(memory_order_relaxed)) b->maxNs[t].store(ns, memory_order_relaxed);
+    }
+
+    // Times the enclosing scope
+    struct ScopedTimer {
+        Timer timer;
+        chrono::steady_clock::time_point start;
+        explicit ScopedTimer(Timer t) : timer(t), start(chrono::steady_clock::now()) {}
+        ~ScopedTimer() {
+            record(timer, chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count());
+        }
+    };
+
+    // A mutex that reports contention: each acquisition counts into TAKEN, and one that had to wait
+    // records how long in the WAIT timer (see CatalogMutex, StripeMutex and RatingMutex below)
+    // Logic: try_lock first, so an uncontended acquisition reads no clock.
+    template <typename M, Timer WAIT, Counter TAKEN>
+    struct Contended : M {
+        void lock() {
+            if (!M::try_lock()) {
+                ScopedTimer waited(WAIT);
+                M::lock();
+            }
+            add(TAKEN, 1);
+        }
+        void lock_shared() {
+            if (!M::try_lock_shared()) {
+                ScopedTimer waited(WAIT);
+                M::lock_shared();
+            }
+            add(TAKEN, 1);
+        }
+    };
+
+    // One counter summed over every thread so far (cheaper than collect() when only it is needed)
+    static uint64_t total(Counter c) {
+        lock_guard<mutex> guard(registry);
+        uint64_t n = retired.counters[c].load(memory_order_relaxed);
+        for (Block* b = live; b; b = b->next) n += b->counters[c].load(memory_order_relaxed);
+        return n;
+    }
+
+    // Every thread's numbers so far, merged into one block. Give it back with release().
+    static Block* collect() {
+        Block* total = new (malloc(sizeof(Block))) Block(); // Over 100 KB: kept off the stack
+        lock_guard<mutex> guard(registry);
+        merge(*total, retired);
+        for (Block* b = live; b; b = b->next) merge(*total, *b);
+        return total;
+    }
+    static void release(Block* total) {
+        total->~Block();
+        free(total);
+    }
+
+    static uint64_t count(const Block& total, Timer t) {
+        uint64_t n = 0;
+        for (int b = 0; b < BUCKETS; b++) n += total.buckets[t][b].load(memory_order_relaxed);
+        return n;
+    }
+
+    // Value at quantile q (0-1) of a timer, to within its bucket
+    static uint64_t percentile(const Block& total, Timer t, double q) {
+        uint64_t maxNs = total.maxNs[t].load(memory_order_relaxed);
+        uint64_t rank = max<uint64_t>(1, uint64_t(q * count(total, t) + 0.5)), seen = 0;
+        for (int b = 0; b < BUCKETS; b++)
+            if ((seen += total.buckets[t][b].load(memory_order_relaxed)) >= rank) return min(bucketTop(b), maxNs);
+        return maxNs;
+    }
+
+    static string duration(uint64_t ns) {
+        ostringstream out;
+        out << fixed << setprecision(1);
+        if (ns >= 1000000000ull) out << ns / 1e9 << " s";
+        else if (ns >= 1000000) out << ns / 1e6 << " ms";
+        else if (ns >= 1000) out << ns / 1e3 << " us";
+        else out << ns << " ns";
+        return out.str();
+    }
+
+    // Prints count, mean, percentiles and max of every timer that ran, then the counters
+    static void dump(ostream& out) {
+        static const char* const timerNames[TIMER_COUNT] = {
+            "load_data", "load_shard", "save_data", "compact", "journal_write", "search", "category_filter", "query", "top_rated", "checkout", "seller_analytics",
+            "catalog_wait", "stripe_wait", "rating_wait"
+        };
+        static const char* const counterNames[COUNTER_COUNT] = {
+            "allocations", "allocated_bytes", "bytes_written", "index_hits", "index_misses", "cache_hits", "cache_misses",
+            "catalog_locks", "stripe_locks", "rating_locks", "stock_retries"
+        };
+        Block* total = collect();
+
+        out << "\n---------------- METRICS ----------------\n";
+        out << left << setw(16) << "timer" << right << setw(10) << "count" << setw(11) << "mean"
+            << setw(11) << "p50" << setw(11) << "p90" << setw(11) << "p99" << setw(11) << "p99.9" << setw(11) << "max" << "\n";
+        for (int t = 0; t < TIMER_COUNT; t++) {
+            Timer timer = Timer(t);
+            uint64_t n = count(*total, timer);
+            if (n == 0) continue;
+            out << left << setw(16) << timerNames[t] << right << setw(10) << n
+                << setw(11) << duration(total->totalNs[t].load(memory_order_relaxed) / n)
+                << setw(11) << duration(percentile(*total, timer, 0.5)) << setw(11) << duration(percentile(*total, timer, 0.9))
+                << setw(11) << duration(percentile(*total, timer, 0.99)) << setw(11) << duration(percentile(*total, timer, 0.999))
+                << setw(11) << duration(total->maxNs[t].load(memory_order_relaxed)) << "\n";
+        }
+        for (int c = 0; c < COUNTER_COUNT; c++)
+            out << left << setw(16) << counterNames[c] << right << setw(10) << total->counters[c].load(memory_order_relaxed) << "\n";
+        out << "-----------------------------------------\n";
+        release(total);
+    }
+};
+
+// Allocation counters: every operator new / new[] of the process goes through here
+void* operator new(size_t n) {
+    Metrics::add(Metrics::ALLOCATIONS, 1);
+    Metrics::add(Metrics::ALLOCATED_BYTES, n);
+    if (void* p = malloc(n ? n : 1)) return p;
+    throw bad_alloc();
+}
+// Note: noinline, or GCC sees free() meet a 'new' pointer once inlined and warns (-Wmismatched-new-delete)
+[[gnu::noinline]] void operator delete(void* p) noexcept { free(p); }
+[[gnu::noinline]] void operator delete(void* p, size_t) noexcept { free(p); }
+
+#define METRIC_JOIN2(a, b) a##b
+#define METRIC_JOIN(a, b) METRIC_JOIN2(a, b)
+#define METRIC_TIMER(timer) Metrics::ScopedTimer METRIC_JOIN(metricTimer, __LINE__)(Metrics::timer)
+#define METRIC_ADD(counter, n) Metrics::add(counter, n)
+
+// The Marketplace locks (see CONCURRENCY), counting acquisitions and timing waits
+typedef Metrics::Contended<shared_mutex, Metrics::CATALOG_WAIT, Metrics::CATALOG_LOCKS> CatalogMutex;
+typedef Metrics::Contended<mutex, Metrics::STRIPE_WAIT, Metrics::STRIPE_LOCKS> StripeMutex;
+typedef Metrics::Contended<mutex, Metrics::RATING_WAIT, Metrics::RATING_LOCKS> RatingMutex;
+#else
+#define METRIC_TIMER(timer) ((void)0)
+#define METRIC_ADD(counter, n) ((void)0)
+
+typedef shared_mutex CatalogMutex;
+typedef mutex StripeMutex;
+typedef mutex RatingMutex;
+#endif
+
 // Represents a product in the marketplace
+// Note: Used as a row value (parsing, inserts). The catalog itself lives in ProductStore.
+// 'name' views the caller's text (a parsed line, an input buffer); ProductStore keeps its own copy.
 class Product {
 public:
     int id;
-    string name;
+    string_view name;
     double price;
-    string category;
+    int categoryId; // Interned: see CategoryTable
     int quantity;   // Current stock level
     int sellerId;   // Links product to a specific seller
 
@@ -51,671 +328,3843 @@ public:
     Product() {}
 
     // Parameterized Constructor
-    Product(int pid, string pname, double pprice, string pcat, int pqty, int sid, double rSum = 0, int rCount = 0) {
-        id = pid;
-        name = pname;
-        price = pprice;
-        category = pcat;
-        quantity = pqty;
-        sellerId = sid;
-        ratingSum = rSum;
-        ratingCount = rCount;
-    }
+    Product(int pid, string_view pname, double pprice, int pcat, int pqty, int sid, double rSum = 0, int rCount = 0)
+        : id(pid), name(pname), price(pprice), categoryId(pcat), quantity(pqty), sellerId(sid),
+          ratingSum(rSum), ratingCount(rCount) {}
 
     // Logic: Calculate average rating (Safe division)
     double getAverageRating() const {
         if (ratingCount == 0) return 0.0;
         return ratingSum / ratingCount;
     }
+};
+
+// Column-oriented product table (Structure of Arrays)
+// DATA STRUCTURE: VECTOR per field + STRING ARENA
+// Reason: Price, stock and rating scans read only the columns they need, packed contiguously,
+// instead of pulling whole Product structs and their string headers through the cache.
+// A row number is a product's position; it never changes once assigned.
+class ProductStore {
+public:
+    // Hot numeric columns, one entry per row
+    vector<int> id;
+    vector<double> price;
+    vector<int> sellerId;
+    vector<int> categoryId; // Interned: see CategoryTable
+    vector<double> ratingSum;
+    vector<int> ratingCount;
+
+private:
+    // Stock levels, updated with atomic compare-and-swap instead of a lock (see reserve / release / commit)
+    // onHand: units not sold yet (the saved stock level); available: onHand minus the units reserved by carts
+    struct Stock {
+        atomic<int> onHand;
+        atomic<int> available;
+        Stock(int qty) : onHand(qty), available(qty) {}
+        // Only used when the vector grows, which happens with the catalog locked exclusively
+        Stock(const Stock& other) : onHand(other.onHand.load()), available(other.available.load()) {}
+    };
+    vector<Stock> stock;
+
+    // Cold strings: all names packed back to back in one buffer
+    string nameArena;
+    vector<size_t> nameStart;
+    vector<uint32_t> nameLength;
+
+    // Generation counters: bumped whenever rows, stock or ratings change (see ResultCache)
+    atomic<uint64_t> rowsGeneration{0};   // Row inserted or updated (name, price, category, stock level...)
+    atomic<uint64_t> stockGeneration{0};  // A product sold out or came back in stock
+    atomic<uint64_t> ratingGeneration{0}; // A rating was added
+
+    static void bump(atomic<uint64_t>& g) { g.fetch_add(1, memory_order_relaxed); }
+
+    // Only a move across zero changes "in stock", so only that bumps the stock generation
+    void stockMoved(int before, int after) {
+        if ((before > 0) != (after > 0)) bump(stockGeneration);
+    }
+
+    void setName(int row, string_view n) {
+        nameStart[row] = nameArena.size();
+        nameLength[row] = n.size();
+        nameArena += n; // A renamed product leaves its old bytes behind until the next load
+    }
+
+public:
+    int size() const { return id.size(); }
+
+    void reserve(size_t rows, size_t nameBytes) {
+        id.reserve(rows); price.reserve(rows); stock.reserve(rows); sellerId.reserve(rows);
+        categoryId.reserve(rows); ratingSum.reserve(rows); ratingCount.reserve(rows);
+        nameStart.reserve(rows); nameLength.reserve(rows);
+        nameArena.reserve(nameBytes);
+    }
+
+    // Room for 'rows' more rows and 'nameBytes' more name text (bulk import)
+    void reserveMore(size_t rows, size_t nameBytes) { reserve(id.size() + rows, nameArena.size() + nameBytes); }
+
+    // Note: The view is invalidated by the next push_back / set (the arena may move)
+    string_view name(int row) const { return string_view(nameArena.data() + nameStart[row], nameLength[row]); }
+
+    // Logic: Calculate average rating (Safe division)
+    double averageRating(int row) const {
+        if (ratingCount[row] == 0) return 0.0;
+        return ratingSum[row] / ratingCount[row];
+    }
+
+    // Note: Go through Marketplace::rateProduct() so the rating ranking moves with it.
+    void addRating(int row, double rate) {
+        ratingSum[row] += rate;
+        ratingCount[row]++;
+        bump(ratingGeneration);
+    }
+
+    // Current version of each kind of data, for tagging cached results
+    struct Generations {
+        uint64_t rows, stock, ratings;
+    };
+    Generations generations() const {
+        return Generations{rowsGeneration.load(memory_order_relaxed), stockGeneration.load(memory_order_relaxed),
+                           ratingGeneration.load(memory_order_relaxed)};
+    }
+
+    void push_back(const Product& p) {
+        id.push_back(p.id); price.push_back(p.price); stock.emplace_back(p.quantity);
+        sellerId.push_back(p.sellerId); categoryId.push_back(p.categoryId);
+        ratingSum.push_back(p.ratingSum); ratingCount.push_back(p.ratingCount);
+        nameStart.push_back(0); nameLength.push_back(0);
+        setName(id.size() - 1, p.name);
+        bump(rowsGeneration);
+    }
+
+    void set(int row, const Product& p) {
+        id[row] = p.id; price[row] = p.price;
+        int reserved = onHand(row) - available(row); // Carts keep their reservations across an update
+        stock[row].onHand = p.quantity;
+        stock[row].available = p.quantity - reserved;
+        sellerId[row] = p.sellerId; categoryId[row] = p.categoryId;
+        ratingSum[row] = p.ratingSum; ratingCount[row] = p.ratingCount;
+        if (name(row) != p.name) setName(row, p.name);
+        bump(rowsGeneration);
+    }
+
+    // --- STOCK RESERVATION ---
+    // Logic: Adding to a cart reserves units (available goes down), removing them releases the reservation,
+    // and checkout commits it (onHand goes down). Each step is a single atomic update, so concurrent
+    // sessions never oversell a product and never wait on each other to change its stock.
+    // Note: The counters publish no other data, so relaxed memory ordering is enough.
+
+    int onHand(int row) const { return stock[row].onHand.load(memory_order_relaxed); }
+    int available(int row) const { return stock[row].available.load(memory_order_relaxed); }
+
+    // Takes 'qty' units out of available stock; fails, changing nothing, if fewer are left
+    bool reserve(int row, int qty) {
+        atomic<int>& a = stock[row].available;
+        int current = a.load(memory_order_relaxed);
+        while (true) {
+            if (current < qty) return false;
+            if (a.compare_exchange_weak(current, current - qty, memory_order_relaxed)) break;
+            METRIC_ADD(Metrics::STOCK_RETRIES, 1); // Another session moved it first (or a spurious failure)
+        }
+        stockMoved(current, current - qty);
+        return true;
+    }
+
+    // Gives reserved units back (item removed from a cart, or a failed commit)
+    void release(int row, int qty) {
+        int before = stock[row].available.fetch_add(qty, memory_order_relaxed);
+        stockMoved(before, before + qty);
+    }
+
+    // Sells 'qty' reserved units. Fails only if fewer are on hand, which carts saved before
+    // reservations existed can cause; the caller then releases the reservation.
+    bool commit(int row, int qty) {
+        atomic<int>& h = stock[row].onHand;
+        int current = h.load(memory_order_relaxed);
+        while (true) {
+            if (current < qty) return false;
+            if (h.compare_exchange_weak(current, current - qty, memory_order_relaxed)) break;
+            METRIC_ADD(Metrics::STOCK_RETRIES, 1); // Another session moved it first (or a spurious failure)
+        }
+        return true;
+    }
+
+    // Sets available = onHand everywhere; carts then reserve their items again (used after loading)
+    void clearReservations() {
+        for (Stock& st : stock) st.available.store(st.onHand.load(memory_order_relaxed), memory_order_relaxed);
+        bump(stockGeneration);
+    }
+
+    // Reserves without checking: a loaded cart may hold more than is left, leaving available below zero
+    void holdForCart(int row, int qty) {
+        int before = stock[row].available.fetch_sub(qty, memory_order_relaxed);
+        stockMoved(before, before - qty);
+    }
+
+    // --- AGGREGATION (seller analytics) ---
+
+    struct Totals {
+        int products = 0;
+        long long units = 0;       // On hand
+        double inventoryValue = 0; // Sum of price x units on hand
+        double ratingSum = 0;
+        long long ratingCount = 0;
+        int lowStock = 0;          // Products with fewer than 'lowStock' units on hand (sold out included)
+        int unrated = 0;
+
+        double averageRating() const { return ratingCount == 0 ? 0.0 : ratingSum / ratingCount; }
+    };
+
+    // Sums the given rows (ascending positions) column by column
+    // Logic: The rows come in runs of neighbours (a seller's products are mostly added together, and an
+    // import takes one block), so each run is reduced straight off the columns, BLOCK rows at a time:
+    // stock is copied out of its atomics first, then branch-free loops do the arithmetic. The doubles
+    // are summed in LANES separate accumulators, which lets the compiler use SIMD adds and multiplies
+    // (it may not reorder a single floating-point sum); the integer counts vectorize as they are.
+    // Note: Caller holds catalogLock (shared) and ratingLock; stock is read as it stands at that moment.
+    Totals aggregate(const vector<int>& rows, int lowStock) const {
+        constexpr int LANES = 4, BLOCK = 256;
+        double value[LANES] = {}, stars[LANES] = {};
+        long long units = 0, ratings = 0;
+        int low = 0, unrated = 0;
+        int qty[BLOCK];
+        for (size_t i = 0; i < rows.size();) {
+            int first = rows[i], n = 1;
+            while (n < BLOCK && i + n < rows.size() && rows[i + n] == first + n) n++;
+            const double* pr = &price[first];
+            const double* rs = &ratingSum[first];
+            const int* rc = &ratingCount[first];
+            for (int k = 0; k < n; k++) qty[k] = stock[first + k].onHand.load(memory_order_relaxed);
+
+            int k = 0;
+            for (; k + LANES <= n; k += LANES) {
+                for (int l = 0; l < LANES; l++) {
+                    value[l] += pr[k + l] * qty[k + l];
+                    stars[l] += rs[k + l];
+                }
+            }
+            for (; k < n; k++) {
+                value[0] += pr[k] * qty[k];
+                stars[0] += rs[k];
+            }
+            for (k = 0; k < n; k++) {
+                units += qty[k];
+                ratings += rc[k];
+                low += qty[k] < lowStock;
+                unrated += rc[k] == 0;
+            }
+            i += n;
+        }
+        Totals t;
+        t.products = rows.size();
+        for (int l = 0; l < LANES; l++) {
+            t.inventoryValue += value[l];
+            t.ratingSum += stars[l];
+        }
+        t.units = units;
+        t.ratingCount = ratings;
+        t.lowStock = low;
+        t.unrated = unrated;
+        return t;
+    }
+};
+
+// Distinct category names, each stored once, plus the products in each category
+// DATA STRUCTURE: INTERNING TABLE (Hash Map name -> ID) + POSTING LISTS (ID -> product positions)
+// Reason: products.txt only has a handful of categories, so products keep a small ID instead of
+// their own copy of the string, and "Filter by Category" becomes a direct list lookup.
+class CategoryTable {
+private:
+    deque<string> names;                 // Category ID -> name (a deque never moves its strings)
+    unordered_map<string_view, int> ids; // Views into 'names'
+    vector<vector<int>> members;         // Category ID -> product positions, ascending
+
+public:
+    // Returns the ID for a name, adding it on first sight
+    int intern(string_view name) {
+        auto it = ids.find(name);
+        if (it != ids.end()) return it->second;
+        int id = names.size();
+        names.emplace_back(name);
+        ids.emplace(string_view(names.back()), id);
+        members.emplace_back();
+        return id;
+    }
+
+    // -1 if no product ever used this category
+    int find(string_view name) const {
+        auto it = ids.find(name);
+        return it == ids.end() ? -1 : it->second;
+    }
+
+    const string& name(int id) const { return names[id]; }
+    int size() const { return names.size(); }
+
+    const vector<int>& productsIn(int id) const { return members[id]; }
+
+    // Products are added in increasing position order, so push_back keeps the list sorted
+    void addProduct(int id, int idx) {
+        vector<int>& list = members[id];
+        if (list.empty() || list.back() < idx) list.push_back(idx);
+        else list.insert(lower_bound(list.begin(), list.end(), idx), idx);
+    }
+
+    void removeProduct(int id, int idx) {
+        vector<int>& list = members[id];
+        auto pos = lower_bound(list.begin(), list.end(), idx);
+        if (pos != list.end() && *pos == idx) list.erase(pos);
+    }
+};
+
+// Persistent ranking of products by average rating (best first)
+// DATA STRUCTURE: BALANCED BST (std::set)
+// Reason: A new rating repositions one product in O(log n), and reading the top K is O(K)
+// with no product copies (replaces rebuilding a Max Heap of every product per request).
+class RatingIndex {
+public:
+    struct Entry {
+        double avg;
+        int idx; // Position in the products vector
+        // Logic: Higher Average Rating first; ties keep catalog order
+        bool operator<(const Entry& other) const {
+            if (avg != other.avg) return avg > other.avg;
+            return idx < other.idx;
+        }
+    };
+
+private:
+    pmr::unsynchronized_pool_resource nodes; // Tree nodes in large blocks (one set node per product)
+    pmr::set<Entry> order{&nodes};
+
+public:
+    // Cursor that sorts before every product: pass it to page() to start from the top
+    static Entry start() { return Entry{numeric_limits<double>::infinity(), -1}; }
+
+    void insert(int idx, double avg) { order.insert(Entry{avg, idx}); }
+    void erase(int idx, double avg) { order.erase(Entry{avg, idx}); }
+    int size() const { return order.size(); }
+
+    // Cursor-based page: up to K positions ranked after 'from', in O(log n + K).
+    // Returns the cursor for the following page. The cursor is a key, not an offset,
+    // so ratings that arrive between pages never make the listing skip or repeat a row.
+    Entry page(const Entry& from, int k, vector<int>& rows) const {
+        rows.clear();
+        Entry next = from;
+        for (auto it = order.upper_bound(from); it != order.end() && (int)rows.size() < k; ++it) {
+            rows.push_back(it->idx);
+            next = *it;
+        }
+        return next;
+    }
+
+    bool hasAfter(const Entry& cursor) const {
+        return order.upper_bound(cursor) != order.end();
+    }
+
+    // Calls f(position) for every product rated minAvg or better, best first: O(matches).
+    // Stops early, returning false, as soon as f returns false.
+    template <typename F>
+    bool forEachAtLeast(double minAvg, F f) const {
+        for (auto it = order.begin(); it != order.end() && it->avg >= minAvg; ++it)
+            if (!f(it->idx)) return false;
+        return true;
+    }
+};
+
+// Products by price (cheapest first)
+// DATA STRUCTURE: BALANCED BST (std::set) keyed by (price, position)
+// Reason: A price range is one lower_bound plus a walk over the matches, instead of a scan of every price.
+class PriceIndex {
+private:
+    struct Entry {
+        double price;
+        int idx;
+        bool operator<(const Entry& other) const {
+            if (price != other.price) return price < other.price;
+            return idx < other.idx;
+        }
+    };
+    pmr::unsynchronized_pool_resource nodes; // Tree nodes in large blocks, as in RatingIndex
+    pmr::set<Entry> order{&nodes};
+
+public:
+    void insert(int idx, double price) { order.insert(Entry{price, idx}); }
+    void erase(int idx, double price) { order.erase(Entry{price, idx}); }
+
+    // Calls f(position) for every product priced in [lo, hi]: O(log n + matches).
+    // Stops early, returning false, as soon as f returns false.
+    template <typename F>
+    bool forEachInRange(double lo, double hi, F f) const {
+        for (auto it = order.lower_bound(Entry{lo, -1}); it != order.end() && it->price <= hi; ++it)
+            if (!f(it->idx)) return false;
+        return true;
+    }
+};
+
+// One bit per product position
+// DATA STRUCTURE: BITMAP (64 rows per word)
+// Reason: A query predicate marks its matches from its own index, in whatever order the index yields
+// them; intersecting is then one bit test per candidate, and reading back gives catalog order.
+class RowBitmap {
+private:
+    vector<uint64_t> words;
+
+public:
+    explicit RowBitmap(int rows) : words((rows + 63) / 64, 0) {}
+
+    void set(int row) { words[row >> 6] |= uint64_t(1) << (row & 63); }
+    bool test(int row) const { return (words[row >> 6] >> (row & 63)) & 1; }
+
+    // Calls f(row) for every set bit, in ascending row order
+    template <typename F>
+    void forEach(F f) const {
+        for (size_t w = 0; w < words.size(); w++)
+            for (uint64_t bits = words[w]; bits != 0; bits &= bits - 1) f(int(w * 64 + __builtin_ctzll(bits)));
+    }
+};
+
+// A multi-attribute product search: every condition that is set must hold
+struct ProductQuery {
+    enum Sort { BY_RATING, PRICE_LOW_HIGH, PRICE_HIGH_LOW };
+
+    string category;               // Empty: any category
+    double minPrice = 0;
+    double maxPrice = numeric_limits<double>::infinity();
+    double minRating = 0;          // Average stars
+    bool inStockOnly = false;
+    Sort sort = BY_RATING;
+};
+
+// Recently used listing results (category pages, name searches, advanced searches)
+// DATA STRUCTURE: LRU CACHE (Hash Map key -> node of a Linked List kept in recency order)
+// Reason: Popular listings are served from memory instead of being filtered and sorted again per customer.
+// Logic: No explicit invalidation. Each result is tagged with the ProductStore generations it was computed
+// at; a lookup whose generations moved on (for the kinds of data the result depends on) is a miss.
+// Note: Results are product positions, which never change once assigned. Bounded by the total rows held.
+class ResultCache {
+public:
+    // What a result depends on besides the rows themselves
+    enum Depends { ON_STOCK = 1, ON_RATINGS = 2 };
+
+    // Every matching position; only the first 'ranked' are in the listing's order (the first few screens)
+    struct Listing {
+        vector<int> rows;
+        size_t ranked;
+        ProductQuery::Sort order;
+    };
+    typedef shared_ptr<const Listing> Rows; // Shared, so a session can page through a result another evicts
+
+private:
+    struct Entry {
+        string key;
+        ProductStore::Generations at;
+        int depends;
+        Rows rows;
+    };
+    list<Entry> order; // Most recently used first
+    unordered_map<string, list<Entry>::iterator> entries;
+    size_t heldRows = 0;
+    size_t maxRows;
+    mutex lock; // Shared by every session
+
+    static bool current(const Entry& e, const ProductStore::Generations& now) {
+        return e.at.rows == now.rows && (!(e.depends & ON_STOCK) || e.at.stock == now.stock)
+               && (!(e.depends & ON_RATINGS) || e.at.ratings == now.ratings);
+    }
+
+    void drop(list<Entry>::iterator it) {
+        heldRows -= it->rows->rows.size();
+        entries.erase(it->key);
+        order.erase(it);
+    }
+
+public:
+    explicit ResultCache(size_t maxRowsHeld) : maxRows(maxRowsHeld) {}
+
+    // The result stored under 'key', or null if there is none that is still current
+    Rows find(const string& key, const ProductStore::Generations& now) {
+        lock_guard<mutex> guard(lock);
+        auto it = entries.find(key);
+        if (it == entries.end()) return nullptr;
+        if (!current(*it->second, now)) {
+            drop(it->second);
+            return nullptr;
+        }
+        order.splice(order.begin(), order, it->second); // Move to the front: O(1)
+        return it->second->rows;
+    }
+
+    // Stores a result computed from the data at generations 'at', evicting the least recently used
+    void put(const string& key, const ProductStore::Generations& at, int depends, Rows rows) {
+        if (rows->rows.size() > maxRows) return;
+        lock_guard<mutex> guard(lock);
+        auto it = entries.find(key);
+        if (it != entries.end()) drop(it->second);
+        heldRows += rows->rows.size();
+        order.push_front(Entry{key, at, depends, move(rows)});
+        entries.emplace(key, order.begin());
+        while (heldRows > maxRows) drop(prev(order.end()));
+    }
+};
+
+// Case-insensitive name search over the catalog
+// DATA STRUCTURE: INVERTED INDEX (Trigram -> sorted list of product positions)
+// Reason: A query only touches the posting lists of its own trigrams, instead of every product name.
+// Logic: Names are indexed with a start-of-name marker, so "starts with" queries are index lookups too.
+class NameIndex {
+private:
+    static constexpr unsigned char START = 1; // Start-of-name marker (never appears in a name)
+
+    unordered_map<uint32_t, vector<int>> postings; // Each list is ascending and duplicate-free
+
+    static unsigned char lower(char ch) { return tolower(static_cast<unsigned char>(ch)); }
+
+    vector<uint32_t> scratch; // Reused by add/remove so indexing a name does not allocate
+
+    // Distinct trigrams of the lowercased text (prefixed with START when anchored), written into 'grams'
+    static void gramsOf(string_view text, bool anchored, vector<uint32_t>& grams) {
+        grams.clear();
+        uint32_t window = anchored ? START : 0; // Last three characters seen, packed
+        int seen = anchored ? 1 : 0;
+        for (char ch : text) {
+            window = ((window << 8) | lower(ch)) & 0xFFFFFF;
+            if (++seen >= 3) grams.push_back(window);
+        }
+        sort(grams.begin(), grams.end());
+        grams.erase(unique(grams.begin(), grams.end()), grams.end());
+    }
+
+    static bool matches(string_view name, string_view query, bool prefix) {
+        if (query.size() > name.size()) return false;
+        size_t last = prefix ? 0 : name.size() - query.size();
+        for (size_t start = 0; start <= last; start++) {
+            size_t i = 0;
+            while (i < query.size() && lower(name[start + i]) == lower(query[i])) i++;
+            if (i == query.size()) return true;
+        }
+        return false;
+    }
+
+public:
+    // Products are added in increasing position order, so push_back keeps every list sorted
+    void add(int idx, string_view name) {
+        gramsOf(name, true, scratch);
+        for (uint32_t g : scratch) {
+            vector<int>& list = postings[g];
+            if (list.empty() || list.back() < idx) list.push_back(idx);
+            else list.insert(lower_bound(list.begin(), list.end(), idx), idx);
+        }
+    }
+
+    void remove(int idx, string_view name) {
+        gramsOf(name, true, scratch);
+        for (uint32_t g : scratch) {
+            auto it = postings.find(g);
+            if (it == postings.end()) continue;
+            auto pos = lower_bound(it->second.begin(), it->second.end(), idx);
+            if (pos != it->second.end() && *pos == idx) it->second.erase(pos);
+        }
+    }
+
+    // Positions (ascending) of products whose name contains the query, or starts with it if 'prefix'.
+    // nameOf(idx) returns a product's name (as a string_view) and is used to confirm candidates; 'count' is the catalog size.
+    // Logic: Intersect the posting lists smallest first, then verify the few survivors.
+    // Queries too short to form a trigram match a large share of the catalog anyway, so they are a plain scan.
+    template <typename NameOf>
+    vector<int> search(const string& query, bool prefix, int count, NameOf nameOf) const {
+        vector<int> result;
+        if (query.empty()) return result;
+
+        vector<uint32_t> grams;
+        gramsOf(query, prefix, grams);
+        if (grams.empty()) {
+            for (int i = 0; i < count; i++) if (matches(nameOf(i), query, prefix)) result.push_back(i);
+            return result;
+        }
+
+        vector<const vector<int>*> lists;
+        for (uint32_t g : grams) {
+            auto it = postings.find(g);
+            if (it == postings.end()) return result; // A trigram nobody has: no match
+            lists.push_back(&it->second);
+        }
+        sort(lists.begin(), lists.end(), [](const vector<int>* a, const vector<int>* b) { return a->size() < b->size(); });
+
+        // Logic: Each candidate is binary-searched in the next (longer) list, moving forward only,
+        // so a rare trigram keeps the cost near O(candidates * log n) even when the others are very common.
+        vector<int> candidates = *lists[0];
+        for (size_t i = 1; i < lists.size() && !candidates.empty(); i++) {
+            const vector<int>& list = *lists[i];
+            auto from = list.begin();
+            size_t kept = 0;
+            for (int idx : candidates) {
+                from = lower_bound(from, list.end(), idx);
+                if (from == list.end()) break;
+                if (*from == idx) candidates[kept++] = idx;
+            }
+            candidates.resize(kept);
+        }
 
-    // Logic: Update rating stats
-    void addRating(double rate) {
-        ratingSum += rate;
-        ratingCount++;
+        // Sharing all trigrams is necessary, not sufficient (e.g. "abcab" vs "cabc")
+        for (int idx : candidates) if (matches(nameOf(idx), query, prefix)) result.push_back(idx);
+        return result;
     }
+};
+
+// Stable storage for the strings of one table
+// DATA STRUCTURE: ARENA (pmr monotonic buffer: large blocks, bump allocation, released all at once)
+// Reason: Loading a table costs a few block allocations instead of one heap allocation per string,
+// and stored text never moves, so rows only hold string_views and copy/relocate for free.
+// Note: Replaced strings stay in the arena until the next load (updates are rare: profile edits, replay).
+class StringPool {
+private:
+    pmr::monotonic_buffer_resource arena{64 * 1024};
 
-    // OPERATOR OVERLOADING
-    // Required for Priority Queue comparisons.
-    // Logic: Higher Average Rating = Higher Priority.
-    bool operator<(const Product& other) const {
-        return getAverageRating() < other.getAverageRating();
+public:
+    // Copies 'text' into the arena; the returned view stays valid for the pool's lifetime
+    string_view store(string_view text) {
+        if (text.empty()) return string_view();
+        char* at = static_cast<char*>(arena.allocate(text.size(), 1));
+        memcpy(at, text.data(), text.size());
+        return string_view(at, text.size());
     }
 };
 
 // Represents a Seller user
+// Note: Strings view Marketplace::sellerStrings once stored (see Marketplace::addSeller).
 class Seller {
 public:
     int id;
-    string name;
-    string email;
+    string_view name;
+    string_view email;
 
-    Seller(int sid, string sname, string semail) {
-        id = sid;
-        name = sname;
-        email = semail;
-    }
+    Seller(int sid, string_view sname, string_view semail) : id(sid), name(sname), email(semail) {}
 };
 
 // Helper struct for items stored inside the cart
+// Logic: Stores only the product id; name and price are looked up live, so the cart never shows a stale price.
 struct CartItem {
-    Product product;
+    int productId;
     int buyQty;
 };
 
+// Shopping Cart
+// DATA STRUCTURE: STACK (LIFO) stored as a VECTOR + HASH MAP side index
+// Reason: Keeps "undo last item" semantics, but lines are contiguous so they can be read in place,
+// removing any product is O(1), and adding the same product twice merges into one line.
+class Cart {
+private:
+    static constexpr int TOMBSTONE = -1; // productId of a removed line
+
+    vector<CartItem> slots;          // Oldest line first, newest line last (top of the stack)
+    unordered_map<int, int> slotOf;  // Product ID -> position in slots
+    int tombstones = 0;
+
+    // Logic: Drop removed lines from the top, and repack once they make up half the vector (amortized O(1))
+    void tidy() {
+        while (!slots.empty() && slots.back().productId == TOMBSTONE) {
+            slots.pop_back();
+            tombstones--;
+        }
+        if (tombstones * 2 <= (int)slots.size()) return;
+        int live = 0;
+        for (const auto& item : slots) {
+            if (item.productId == TOMBSTONE) continue;
+            slotOf[item.productId] = live;
+            slots[live++] = item;
+        }
+        slots.resize(live);
+        tombstones = 0;
+    }
+
+public:
+    bool empty() const { return slotOf.empty(); }
+    int size() const { return slotOf.size(); }
+
+    int quantityOf(int productId) const {
+        auto it = slotOf.find(productId);
+        return it == slotOf.end() ? 0 : slots[it->second].buyQty;
+    }
+
+    // Push: a product already in the cart keeps its line and gets the extra quantity
+    void add(int productId, int qty) {
+        auto it = slotOf.find(productId);
+        if (it != slotOf.end()) {
+            slots[it->second].buyQty += qty;
+            return;
+        }
+        slotOf[productId] = slots.size();
+        slots.push_back(CartItem{productId, qty});
+    }
+
+    // Remove by id: the slot becomes a tombstone instead of shifting the lines above it
+    bool remove(int productId) {
+        auto it = slotOf.find(productId);
+        if (it == slotOf.end()) return false;
+        slots[it->second].productId = TOMBSTONE;
+        slotOf.erase(it);
+        tombstones++;
+        tidy();
+        return true;
+    }
+
+    // Pop: removes the most recently added line
+    bool undoLast(CartItem& removed) {
+        if (empty()) return false; // tidy() guarantees the last slot is live
+        removed = slots.back();
+        return remove(removed.productId);
+    }
+
+    void clear() {
+        slots.clear();
+        slotOf.clear();
+        tombstones = 0;
+    }
+
+    // In-place iteration, bottom of the stack (oldest) first
+    template <typename F>
+    void forEach(F f) const {
+        for (const auto& item : slots) if (item.productId != TOMBSTONE) f(item);
+    }
+
+    // In-place iteration, top of the stack (newest) first
+    template <typename F>
+    void forEachNewestFirst(F f) const {
+        for (auto it = slots.rbegin(); it != slots.rend(); ++it) if (it->productId != TOMBSTONE) f(*it);
+    }
+};
+
 // Represents a Customer user
+// Note: Strings view the string pool of the customer's shard once stored (see Marketplace::addCustomer).
 class Customer {
 public:
     int id;
-    string name;
-    string address;
-    string phone;
-    string email;
+    string_view name;
+    string_view address;
+    string_view phone;
+    string_view email;
 
-    // DATA STRUCTURE: STACK
+    // DATA STRUCTURE: STACK (see Cart)
     // Reason: Allows the "Undo" feature. The last item added is the first to be removed (LIFO).
-    //
-    stack<CartItem> cartStack;
+    Cart cart;
+
+    bool unsaved = false; // Changed since its shard files were last written (see Marketplace::CustomerShard)
+
+    Customer(int cid, string_view cname, string_view caddr, string_view cphone, string_view cemail)
+        : id(cid), name(cname), address(caddr), phone(cphone), email(cemail) {}
+};
+
+// Read-only view of a whole data file
+// Reason: Memory-mapping lets the loader parse records in place, with no per-line copies.
+class MappedFile {
+private:
+    const char* data = nullptr;
+    size_t length = 0;
+    bool opened = false;
+#ifdef _WIN32
+    string buffer; // Fallback: read the file in one go
+#endif
+
+public:
+    MappedFile(const string& path) {
+#ifdef _WIN32
+        ifstream file(path, ios::binary);
+        if (!file.is_open()) return;
+        buffer.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+        data = buffer.data();
+        length = buffer.size();
+        opened = true;
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        struct stat st;
+        if (fstat(fd, &st) == 0) {
+            opened = true;
+            length = st.st_size;
+            if (length > 0) {
+                void* addr = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (addr == MAP_FAILED) { opened = false; length = 0; }
+                else data = static_cast<const char*>(addr);
+            }
+        }
+        close(fd); // The mapping stays valid after the descriptor is closed
+#endif
+    }
+
+    ~MappedFile() {
+#ifndef _WIN32
+        if (data != nullptr) munmap(const_cast<char*>(data), length);
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool isOpen() const { return opened; }
+    string_view view() const { return string_view(data, length); }
+};
 
-    Customer(int cid, string cname, string caddr, string cphone, string cemail) {
-        id = cid;
-        name = cname;
-        address = caddr;
-        phone = cphone;
-        email = cemail;
+// Runs work(0) ... work(tasks - 1) on up to one thread per core, and returns once all are done
+// DATA STRUCTURE: THREAD POOL (workers pull task numbers from one atomic counter)
+// Reason: Tasks of uneven size (file chunks of different tables) still keep every core busy.
+template <typename F>
+void parallelFor(int tasks, F work) {
+    int workers = min<int>(tasks, max(1u, thread::hardware_concurrency()));
+    atomic<int> next{0};
+    auto loop = [&] {
+        for (int t = next++; t < tasks; t = next++) work(t);
+    };
+    vector<thread> pool;
+    for (int i = 1; i < workers; i++) pool.emplace_back(loop);
+    loop(); // The calling thread works too
+    for (thread& w : pool) w.join();
+}
+
+// Parsing helpers for the pipe-delimited data files
+// Logic: Fields are string_views into the mapped file; numbers are parsed with from_chars (no allocation, no locale).
+struct TextRecord {
+    // Calls f(line) for every non-empty line, with Windows '\r' endings stripped
+    template <typename F>
+    static void forEachLine(string_view text, F f) {
+        while (!text.empty()) {
+            const char* nl = static_cast<const char*>(memchr(text.data(), '\n', text.size()));
+            size_t len = nl ? nl - text.data() : text.size();
+            string_view line = text.substr(0, len);
+            if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+            if (!line.empty()) f(line);
+            text.remove_prefix(nl ? len + 1 : len);
+        }
+    }
+
+    // Splits one line on '|' (or 'sep') into a reused buffer (no allocation once the buffer has grown)
+    static void split(string_view line, vector<string_view>& fields, char sep = '|') {
+        fields.clear();
+        size_t start = 0;
+        while (true) {
+            size_t bar = line.find(sep, start);
+            if (bar == string_view::npos) { fields.push_back(line.substr(start)); return; }
+            fields.push_back(line.substr(start, bar - start));
+            start = bar + 1;
+        }
+    }
+
+    // Cuts 'text' into at most 'parts' pieces of similar size, each ending at a line break,
+    // so the pieces can be parsed by separate threads
+    static vector<string_view> splitChunks(string_view text, int parts) {
+        vector<string_view> chunks;
+        size_t target = text.size() / max(1, parts) + 1;
+        while (!text.empty()) {
+            size_t end = text.size();
+            if (target < text.size()) {
+                size_t nl = text.find('\n', target);
+                if (nl != string_view::npos) end = nl + 1;
+            }
+            chunks.push_back(text.substr(0, end));
+            text.remove_prefix(end);
+        }
+        return chunks;
+    }
+
+    // Number of threads for parsing 'bytes' of text: one per core, but no thread gets less than 'minBytes'
+    static int parseThreads(size_t bytes, size_t minBytes = 1 << 16) {
+        int cores = max(1u, thread::hardware_concurrency());
+        return (int)max<size_t>(1, min<size_t>(cores, bytes / minBytes));
+    }
+
+    static string_view trim(string_view s) {
+        while (!s.empty() && isspace((unsigned char)s.front())) s.remove_prefix(1);
+        while (!s.empty() && isspace((unsigned char)s.back())) s.remove_suffix(1);
+        return s;
+    }
+
+    // Field parsers: the whole field must be the number ("12abc" is malformed, not 12)
+    template <typename Int>
+    static bool toInt(string_view s, Int& out) {
+        auto res = from_chars(s.data(), s.data() + s.size(), out);
+        return res.ec == errc() && res.ptr == s.data() + s.size();
+    }
+
+    static bool toDouble(string_view s, double& out) {
+        auto res = from_chars(s.data(), s.data() + s.size(), out);
+        return res.ec == errc() && res.ptr == s.data() + s.size();
+    }
+
+    // Number formatting for the writers: to_chars straight into 'out', no stream or temporary string
+    static void writeInt(string& out, long long v) {
+        char buf[24];
+        out.append(buf, to_chars(buf, buf + sizeof(buf), v).ptr);
+    }
+
+    // Same text as 'cout << v' with default settings (6 significant digits), so files do not change
+    static void writeDouble(string& out, double v) {
+        char buf[32];
+        out.append(buf, to_chars(buf, buf + sizeof(buf), v, chars_format::general, 6).ptr);
+    }
+};
+
+// Versioned binary snapshot of the whole database (marketplace.bin)
+// Layout: Header | Seller records | Customer records | Product records | Cart records | String heap
+// Reason: Fixed-width records are read straight out of the mapped file, so startup has no text parsing.
+// Strings live once in the heap and records point at them by offset and length.
+// Note: Native byte order; a snapshot is read back on the same kind of machine that wrote it.
+struct BinarySnapshot {
+    static constexpr char MAGIC[8] = {'M', 'K', 'T', 'S', 'N', 'A', 'P', '\0'};
+    static constexpr uint32_t VERSION = 1;
+
+    struct StrRef { uint32_t offset; uint32_t length; };
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t sellerCount;
+        uint32_t customerCount;
+        uint32_t productCount;
+        uint32_t cartCount;
+        uint32_t reserved;
+        uint64_t heapSize;
+        uint64_t checksum; // FNV-1a of everything after the header
+    };
+
+    // Records: see RecordFormat (binary layout) and the *Format typedefs below
+
+    static uint64_t checksum(const char* data, size_t n) {
+        uint64_t h = 14695981039346656037ULL;
+        for (size_t i = 0; i < n; i++) {
+            h ^= static_cast<unsigned char>(data[i]);
+            h *= 1099511628211ULL;
+        }
+        return h;
+    }
+
+    // Records are copied out with memcpy: the mapped bytes carry no alignment guarantee
+    template <typename T>
+    static T read(const char*& at) {
+        T value;
+        memcpy(&value, at, sizeof(T));
+        at += sizeof(T);
+        return value;
+    }
+
+    template <typename T>
+    static void write(string& out, const T& value) {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+};
+
+// Record rows: one table line as plain values. String fields view the text they were read from.
+// Note: A product's category stays text here; interning it needs the catalog (see Marketplace::addProductRow).
+struct SellerRow {
+    int id;
+    string_view name, email;
+};
+
+struct CustomerRow {
+    int id;
+    string_view name, address, phone, email;
+};
+
+struct ProductRow {
+    int id;
+    string_view name;
+    double price;
+    string_view category;
+    int quantity, sellerId;
+    double ratingSum;
+    int ratingCount;
+};
+
+struct CartRow {
+    int customerId, productId, quantity;
+};
+
+// COMPILE-TIME RECORD FORMATS
+// Each table names its row's fields once, in file order (the *Format typedefs below). Everything else is
+// generated from that list: the text writer and parser ("1|Ahmed|a@x.com") and the fixed-width binary
+// record. A field is an int, a double or a string_view; overloads pick each field's code at compile time.
+// Reason: Fold expressions unroll the field list, so the loops over rows do no per-field dispatch and no
+// iostreams (numbers go through to_chars / from_chars), and the loader and saver cannot disagree on a field.
+// Binary layout: the 8-byte fields, then the 4-byte ones, then the string references, each group in
+// field order. That keeps every field aligned, and is exactly the layout of the format version 1 records.
+template <typename Row, auto... Members>
+struct RecordFormat {
+private:
+    typedef TextRecord T;
+    typedef BinarySnapshot::StrRef StrRef;
+
+    template <typename C, typename V>
+    static V fieldType(V C::*); // Declared only: decltype(fieldType(member)) is the field's type
+
+    static void writeField(string& out, int v) { T::writeInt(out, v); }
+    static void writeField(string& out, double v) { T::writeDouble(out, v); }
+    static void writeField(string& out, string_view v) { out += v; }
+
+    static bool readField(string_view s, int& v) { return T::toInt(s, v); }
+    static bool readField(string_view s, double& v) { return T::toDouble(s, v); }
+    static bool readField(string_view s, string_view& v) { v = s; return true; }
+
+    // Group of a field in the binary record: its width, or 0 for a string (stored as a StrRef)
+    static constexpr size_t group(int) { return sizeof(int32_t); }
+    static constexpr size_t group(double) { return sizeof(double); }
+    static constexpr size_t group(string_view) { return 0; }
+    static constexpr size_t binarySize(int) { return sizeof(int32_t); }
+    static constexpr size_t binarySize(double) { return sizeof(double); }
+    static constexpr size_t binarySize(string_view) { return sizeof(StrRef); }
+
+    template <size_t G, typename V, typename Ref>
+    static void writeGroup(string& out, const V& v, Ref& ref) {
+        if constexpr (group(V()) != G) return;
+        else if constexpr (G == 0) BinarySnapshot::write(out, ref(v));
+        else if constexpr (G == 4) BinarySnapshot::write(out, int32_t(v));
+        else BinarySnapshot::write(out, v);
+    }
+
+    template <size_t G, typename V, typename Str>
+    static void readGroup(const char*& at, V& v, Str& str) {
+        if constexpr (group(V()) != G) return;
+        else if constexpr (G == 0) v = str(BinarySnapshot::read<StrRef>(at));
+        else if constexpr (G == 4) v = BinarySnapshot::read<int32_t>(at);
+        else v = BinarySnapshot::read<V>(at);
+    }
+
+public:
+    static constexpr size_t FIELDS = sizeof...(Members);
+
+    // --- TEXT: fields joined by '|' ---
+
+    static void writeText(string& out, const Row& r) {
+        size_t i = 0;
+        ((i++ == 0 ? void() : void(out += '|'), writeField(out, r.*Members)), ...);
+    }
+
+    // Fields [at, at + FIELDS) of a split line -> 'r'. Returns false for a malformed line.
+    static bool readText(const vector<string_view>& f, size_t at, Row& r) {
+        if (f.size() < at + FIELDS) return false;
+        return (readField(f[at++], r.*Members) && ...);
+    }
+
+    // --- BINARY: fixed-width records; strings go to the snapshot heap via ref(string_view) -> StrRef ---
+
+    static constexpr size_t BINARY_SIZE = (binarySize(decltype(fieldType(Members))()) + ...);
+
+    template <typename Ref>
+    static void writeBinary(string& out, const Row& r, Ref ref) {
+        (writeGroup<8>(out, r.*Members, ref), ...);
+        (writeGroup<4>(out, r.*Members, ref), ...);
+        (writeGroup<0>(out, r.*Members, ref), ...);
+    }
+
+    // Reads one record at 'at' (advanced past it); str(StrRef) -> string_view into the heap
+    template <typename Str>
+    static void readBinary(const char*& at, Row& r, Str str) {
+        (readGroup<8>(at, r.*Members, str), ...);
+        (readGroup<4>(at, r.*Members, str), ...);
+        (readGroup<0>(at, r.*Members, str), ...);
+    }
+};
+
+typedef RecordFormat<SellerRow, &SellerRow::id, &SellerRow::name, &SellerRow::email> SellerFormat;
+typedef RecordFormat<CustomerRow, &CustomerRow::id, &CustomerRow::name, &CustomerRow::address,
+                     &CustomerRow::phone, &CustomerRow::email> CustomerFormat;
+typedef RecordFormat<ProductRow, &ProductRow::id, &ProductRow::name, &ProductRow::price, &ProductRow::category,
+                     &ProductRow::quantity, &ProductRow::sellerId, &ProductRow::ratingSum, &ProductRow::ratingCount> ProductFormat;
+typedef RecordFormat<CartRow, &CartRow::customerId, &CartRow::productId, &CartRow::quantity> CartFormat; // carts.<k>.txt lines
+static_assert(SellerFormat::BINARY_SIZE == 20 && CustomerFormat::BINARY_SIZE == 36 && ProductFormat::BINARY_SIZE == 48
+              && CartFormat::BINARY_SIZE == 12, "Binary record layout changed: bump BinarySnapshot::VERSION");
+
+// POINT-IN-TIME SNAPSHOT (epoch copy of the tables one compaction writes, see Marketplace::captureSnapshot)
+// Reason: Copying rows costs a fraction of formatting them, so compaction holds the catalog lock only for
+// the copy. The background writer formats the files from it while sessions keep changing the live tables.
+// Note: Seller, customer and category text is viewed in place: those stores never move or free text that a
+// pending snapshot still needs (customer shards are only evicted once their snapshot is on disk, see
+// Marketplace::CustomerShard). Product names live in a buffer that moves as it grows, so they are copied.
+struct TableSnapshot {
+    bool binary = false; // marketplace.bin (every table), or the text files of 'tables'
+    int tables = 0;      // Marketplace::Table bits
+
+    struct Shard {
+        int number; // Customer shard (see Marketplace::shardOf)
+        vector<CustomerRow> customers;
+        vector<CartRow> carts;  // Each cart bottom of the stack first
+    };
+    vector<SellerRow> sellers;
+    vector<Shard> shards;
+    vector<ProductRow> products;
+    vector<int> productCategories;  // Category ID of each product (the binary format stores each name once)
+    vector<string_view> categories; // Category ID -> name
+    StringPool productNames;
+};
+
+// One product line of a completed order
+struct OrderItem {
+    int productId;
+    int qty;
+    double price; // Unit price charged
+};
+
+// A completed order, as stored in orders.txt
+struct Order {
+    int id = 0;
+    int customerId = 0;
+    long long timestamp = 0; // Seconds since the epoch
+    double total = 0;
+    vector<OrderItem> items;
+};
+
+// Append-only order history (orders.txt), one line per order:
+// OrderID|CustomerID|Timestamp|Total|ProductID|Qty|Price|ProductID|Qty|Price...
+// Reason: Orders are never rewritten, so analytics can stream the file front to back.
+// Note: Lines are appended by the Journal writer right after the checkout that produced them.
+struct OrderLog {
+    static string format(const Order& o) {
+        string out;
+        TextRecord::writeInt(out, o.id); out += '|';
+        TextRecord::writeInt(out, o.customerId); out += '|';
+        TextRecord::writeInt(out, o.timestamp); out += '|';
+        TextRecord::writeDouble(out, o.total);
+        for (const auto& item : o.items) {
+            out += '|'; TextRecord::writeInt(out, item.productId);
+            out += '|'; TextRecord::writeInt(out, item.qty);
+            out += '|'; TextRecord::writeDouble(out, item.price);
+        }
+        return out;
+    }
+
+    // Parses one line into 'o', reusing its item vector; false if the line is malformed
+    static bool parse(string_view line, vector<string_view>& f, Order& o) {
+        TextRecord::split(line, f);
+        if (f.size() < 4 || (f.size() - 4) % 3 != 0) return false;
+        if (!TextRecord::toInt(f[0], o.id) || !TextRecord::toInt(f[1], o.customerId) ||
+            !TextRecord::toInt(f[2], o.timestamp) || !TextRecord::toDouble(f[3], o.total)) return false;
+        o.items.clear();
+        for (size_t i = 4; i + 2 < f.size(); i += 3) {
+            OrderItem item;
+            if (!TextRecord::toInt(f[i], item.productId) || !TextRecord::toInt(f[i + 1], item.qty) ||
+                !TextRecord::toDouble(f[i + 2], item.price)) return false;
+            o.items.push_back(item);
+        }
+        return true;
+    }
+
+    // Streams every order through f(const Order&) at a fixed memory cost:
+    // one line buffer, one field buffer and one Order are reused for the whole file.
+    // Logic: A last line without its newline is still being written, so it is skipped.
+    template <typename F>
+    static void forEach(const string& path, F f) {
+        ifstream in(path, ios::binary);
+        string line;
+        vector<string_view> fields;
+        Order o;
+        while (getline(in, line)) {
+            if (in.eof()) break;
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (parse(line, fields, o)) f(o);
+        }
+    }
+
+    // Id of the last order in the file (0 if there is none); reads only the end of the file
+    static int lastId(const string& path) {
+        ifstream in(path, ios::binary | ios::ate);
+        if (!in) return 0;
+        long long size = in.tellg();
+        string tail;
+        for (long long chunk = 4096; ; chunk *= 4) {
+            long long from = max(0LL, size - chunk);
+            tail.resize(size - from);
+            in.seekg(from);
+            in.read(&tail[0], tail.size());
+            // Drop the unfinished last line (if any), then look for the start of the line before it
+            size_t end = tail.rfind('\n');
+            if (end == string::npos) { if (from == 0) return 0; continue; }
+            size_t start = end == 0 ? string::npos : tail.rfind('\n', end - 1);
+            if (start == string::npos && from > 0) continue;
+            size_t begin = start == string::npos ? 0 : start + 1;
+            size_t bar = tail.find('|', begin);
+            int id = 0;
+            if (bar != string::npos && bar < end) TextRecord::toInt(string_view(tail).substr(begin, bar - begin), id);
+            return id;
+        }
+    }
+};
+
+// Append-only log of mutations since the last full save (Write-Ahead Journal)
+// Reason: One cart click appends one short line instead of rewriting every data file.
+// Every record is a full-row upsert keyed by id, so replaying it over a snapshot is always safe.
+//
+// BACKGROUND PERSISTENCE THREAD
+// Reason: Callers never wait on the disk. append() and replaceSnapshot() only queue work; a writer
+// thread drains the queue every flush interval (or on sync/close), coalescing everything queued since
+// its last pass into one journal write. Snapshots are formatted on that thread too, then written as a
+// group (see writeGroup).
+// Note: A crash can lose at most the last flush interval of changes; the files on disk stay consistent.
+class Journal {
+public:
+    // Builds the files of a snapshot: file name -> full contents
+    typedef function<vector<pair<string, string>>()> SnapshotWriter;
+
+    // Lists the files of the last snapshot group (see writeGroup)
+    static constexpr const char* MANIFEST = "manifest.txt";
+
+private:
+    // One queued unit of work: a journal record, or a snapshot whose files replace the journal
+    struct Task {
+        string record;
+        SnapshotWriter snapshot;
+        string logPath, logLine; // Appended to another log once 'record' is in the journal
+        int replaced;            // Snapshot: journal records it folds in (still in the journal if it fails)
+    };
+
+    string path;
+    atomic<int> recordCount{0}; // Appended to by every session thread
+    int flushIntervalMs = 100;
+
+    mutex lock;
+    condition_variable wake;    // Work queued / stop requested / sync requested
+    condition_variable drained; // The writer finished a pass
+    deque<Task> queue;
+    long long queuedCount = 0;  // Tasks ever queued
+    long long writtenCount = 0; // Tasks ever written
+    bool stopping = false;
+    bool syncing = false;
+    thread writer;
+    long long generation = 0;   // Of the last snapshot group written (see recover)
+    long long failedTicket = 0; // Last snapshot whose files could not be written (see written)
+    atomic<bool> snapshotFailed{false};
+
+    // Writes the tasks numbered first, first + 1, ...; returns the number of the last snapshot that failed, or 0
+    // Note: A snapshot that fails leaves the journal as it is, so it still holds every change since the last
+    // snapshot that made it to disk.
+    long long writeBatch(deque<Task>& batch, ofstream& file, long long first) {
+        METRIC_TIMER(JOURNAL_WRITE);
+        string pending;              // Coalesced journal records
+        vector<const Task*> logged;  // Their log lines, written only after the journal (replay repairs a gap)
+        auto writePending = [&] {
+            METRIC_ADD(Metrics::BYTES_WRITTEN, pending.size());
+            file << pending;
+            file.flush();
+            pending.clear();
+            for (const Task* task : logged) {
+                ofstream log(task->logPath, ios::app);
+                log << task->logLine << '\n';
+            }
+            logged.clear();
+        };
+        long long failed = 0;
+        for (size_t i = 0; i < batch.size(); i++) {
+            Task& task = batch[i];
+            if (!task.snapshot) {
+                pending += task.record;
+                pending += '\n';
+                if (!task.logPath.empty()) logged.push_back(&task);
+                continue;
+            }
+            // Records before a snapshot are already inside it, but they are still written first:
+            // if the process dies between two file renames, replaying them repairs the mix of old and new files.
+            writePending();
+            if (!writeGroup(task.snapshot())) {
+                cerr << "[WARNING] Could not write the data files; the journal keeps the changes.\n";
+                recordCount += task.replaced; // They still count towards the next compaction
+                failed = first + i;
+                continue;
+            }
+            file.close();
+            file.open(path, ios::trunc);
+        }
+        writePending();
+        return failed;
+    }
+
+    // SNAPSHOT GROUP (write-ahead manifest)
+    // Logic: A snapshot's files replace the old ones together, in three steps:
+    //   1. Every file is written to "<name>.tmp" and flushed to disk.
+    //   2. The manifest is replaced by the list of those files with their sizes and checksums. This is the
+    //      commit point: from here on the new snapshot is the current one.
+    //   3. Each temp file is renamed over its data file; only then is the journal truncated.
+    // A crash before step 2 leaves the old files and manifest (the journal still holds every change), and
+    // recover() finishes a crash during step 3, so a restart never sees files of two different snapshots.
+    // Format: G|<generation>|<file count>, then one F|<name>|<size>|<checksum> line per file
+    // Returns false if a file could not be written or renamed; the journal must then be kept.
+    bool writeGroup(const vector<pair<string, string>>& files) {
+        string manifest = "G|";
+        TextRecord::writeInt(manifest, generation + 1);
+        manifest += '|';
+        TextRecord::writeInt(manifest, files.size());
+        manifest += '\n';
+        bool ok = true;
+        for (const auto& f : files) {
+            METRIC_ADD(Metrics::BYTES_WRITTEN, f.second.size());
+            if (ok) ok = writeDurably(f.first + ".tmp", f.second);
+            manifest += "F|" + f.first + '|';
+            TextRecord::writeInt(manifest, f.second.size());
+            manifest += '|';
+            manifest += to_string(BinarySnapshot::checksum(f.second.data(), f.second.size()));
+            manifest += '\n';
+        }
+        // Only a complete set of .tmp files is committed: otherwise the old files (and the journal) stay as they are
+        if (!ok || !writeFileAtomically(MANIFEST, manifest)) {
+            for (const auto& f : files) remove((f.first + ".tmp").c_str());
+            return false;
+        }
+        generation++;
+        syncDirectory(); // The manifest is in place before any data file changes
+        // Note: A file left behind by a failed rename is still rolled forward by recover() on the next start.
+        for (const auto& f : files) ok = rename((f.first + ".tmp").c_str(), f.first.c_str()) == 0 && ok;
+        syncDirectory(); // The renames are durable before the journal goes
+        return ok;
+    }
+
+    // Writes and flushes 'contents' to 'name' (replacing it). Returns false unless every byte reached the disk.
+    static bool writeDurably(const string& name, const string& contents) {
+        FILE* f = fopen(name.c_str(), "wb");
+        if (f == nullptr) return false;
+        bool ok = fwrite(contents.data(), 1, contents.size(), f) == contents.size();
+        ok = fflush(f) == 0 && ok;
+#ifndef _WIN32
+        ok = fsync(fileno(f)) == 0 && ok; // Make the new contents durable before they replace the old file
+#endif
+        ok = fclose(f) == 0 && ok;
+        return ok;
+    }
+
+    // Makes renames in the data directory durable
+    static void syncDirectory() {
+#ifndef _WIN32
+        int fd = ::open(".", O_RDONLY);
+        if (fd < 0) return;
+        fsync(fd);
+        ::close(fd);
+#endif
+    }
+
+    void run() {
+        ofstream file(path, ios::app);
+        unique_lock<mutex> guard(lock);
+        while (true) {
+            wake.wait(guard, [this] { return stopping || syncing || !queue.empty(); });
+            // Let more work pile up for one interval, unless someone is waiting on us
+            wake.wait_for(guard, chrono::milliseconds(flushIntervalMs), [this] { return stopping || syncing; });
+
+            deque<Task> batch;
+            batch.swap(queue);
+            bool stop = stopping;
+            guard.unlock();
+            long long failed = writeBatch(batch, file, writtenCount + 1);
+            guard.lock();
+
+            if (failed != 0) {
+                failedTicket = failed;
+                snapshotFailed = true;
+            }
+            writtenCount += batch.size();
+            if (queue.empty()) syncing = false;
+            drained.notify_all();
+            if (stop && queue.empty()) return;
+        }
+    }
+
+    // Returns the task's number (tasks are written in number order)
+    long long enqueue(Task task) {
+        long long number;
+        {
+            lock_guard<mutex> guard(lock);
+            queue.push_back(move(task));
+            number = ++queuedCount;
+        }
+        wake.notify_one();
+        return number;
+    }
+
+public:
+    Journal(string jpath) {
+        path = jpath;
+    }
+
+    // Writes 'contents' to 'name' through a temp file + rename, so readers see the old or the new file, never half of one.
+    // Returns false (leaving the old file in place) if the new one could not be written.
+    static bool writeFileAtomically(const string& name, const string& contents) {
+        string tmp = name + ".tmp";
+        if (!writeDurably(tmp, contents)) {
+            remove(tmp.c_str());
+            return false;
+        }
+        return rename(tmp.c_str(), name.c_str()) == 0;
+    }
+
+    // Finishes a snapshot group cut short by a crash. Call before the data files are read.
+    // Logic: A temp file the manifest lists, with the listed size and checksum, belongs to the committed
+    // group and is renamed into place (the rest of the group already was). A temp file that does not match
+    // is left over from a group that never committed, and is removed.
+    void recover() {
+        MappedFile manifest(MANIFEST);
+        if (!manifest.isOpen()) return;
+        vector<string_view> f;
+        TextRecord::forEachLine(manifest.view(), [&](string_view line) {
+            TextRecord::split(line, f);
+            if (f[0] == "G" && f.size() == 3) TextRecord::toInt(f[1], generation);
+            uint64_t size, sum;
+            if (f[0] != "F" || f.size() != 4 || !TextRecord::toInt(f[2], size) || !TextRecord::toInt(f[3], sum)) return;
+            string name(f[1]), tmp = name + ".tmp";
+            bool committed;
+            {
+                MappedFile file(tmp);
+                if (!file.isOpen()) return; // Renamed before the stop
+                committed = file.view().size() == size && BinarySnapshot::checksum(file.view().data(), size) == sum;
+            }
+            if (committed) rename(tmp.c_str(), name.c_str());
+            else remove(tmp.c_str());
+        });
+        syncDirectory();
+    }
+
+    ~Journal() {
+        close();
+    }
+
+    // Starts the writer thread
+    void open(int intervalMs) {
+        flushIntervalMs = intervalMs;
+        writer = thread(&Journal::run, this);
+    }
+
+    void append(string record) {
+        enqueue(Task{move(record), nullptr, string(), string(), 0});
+        recordCount++;
+    }
+
+    // Appends records that only make sense together. Format: "B|<count>" followed by the records.
+    // Logic: The group is one queued unit, written in one piece; replay skips a group cut short by a crash.
+    // If 'logPath' is given, 'logLine' is appended to that file right after the group is written.
+    void appendGroup(const vector<string>& records, const string& logPath = string(), const string& logLine = string()) {
+        string group = "B|" + to_string(records.size());
+        for (const string& r : records) {
+            group += '\n';
+            group += r;
+        }
+        enqueue(Task{move(group), nullptr, logPath, logLine, 0});
+        recordCount += records.size() + 1;
+    }
+
+    // Queues a full snapshot, built on the writer thread by 'snapshot'; once its files are in place the
+    // journal file is truncated. Returns a ticket for written().
+    long long replaceSnapshot(SnapshotWriter snapshot) {
+        return enqueue(Task{string(), move(snapshot), string(), string(), recordCount.exchange(0)});
+    }
+
+    // Whether the snapshot behind a replaceSnapshot() ticket is on disk (a ticket of 0 always is)
+    // Note: After a failed snapshot, no earlier ticket counts as written either, until a later one succeeds.
+    bool written(long long ticket) {
+        lock_guard<mutex> guard(lock);
+        return ticket == 0 || (writtenCount >= ticket && ticket > failedTicket);
+    }
+
+    // Whether a snapshot failed since the last call: the next one must then write every table again
+    bool takeSnapshotFailure() { return snapshotFailed.exchange(false); }
+    bool hasSnapshotFailure() const { return snapshotFailed; }
+
+    int size() const { return recordCount; }
+    void setSize(int n) { recordCount = n; }
+
+    // Blocks until everything queued so far is on disk
+    void sync() {
+        unique_lock<mutex> guard(lock);
+        long long target = queuedCount;
+        syncing = true;
+        wake.notify_one();
+        drained.wait(guard, [&] { return writtenCount >= target; });
+    }
+
+    // Flushes everything and stops the writer thread
+    void close() {
+        if (!writer.joinable()) return;
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_one();
+        writer.join();
+    }
+};
+
+// One connected user: where their input comes from and who they are logged in as
+// Reason: Replaces the single currentSellerIdx / currentCustomerIdx, so several users can be served at once.
+struct Session {
+    istream& in;
+    ostream& out;
+    bool console;         // Local terminal, or a remote client (see Marketplace::serve)
+    int sellerIdx = -1;   // Position of the logged-in seller in sellers, or -1
+    int customerIdx = -1; // Position of the logged-in customer in customers, or -1
+};
+
+// Thrown by the input helpers when a session's input ends, to unwind its menus
+struct SessionClosed {};
+
+#ifndef _WIN32
+// Stream buffer over a connected socket, so the menus talk to a remote client through an iostream
+// Logic: Pending output is sent before blocking on input (the prompt must reach the client first).
+// Carriage returns are dropped, so telnet-style "\r\n" lines read like console lines.
+class SocketBuf : public streambuf {
+private:
+    int fd;
+    char inBuf[1024];
+    char outBuf[4096];
+
+    bool sendPending() {
+        const char* at = pbase();
+        while (at < pptr()) {
+            ssize_t n = send(fd, at, pptr() - at, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            at += n;
+        }
+        setp(outBuf, outBuf + sizeof(outBuf));
+        return true;
+    }
+
+protected:
+    int underflow() override {
+        sendPending();
+        while (true) {
+            ssize_t n = recv(fd, inBuf, sizeof(inBuf), 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return traits_type::eof();
+            char* end = remove(inBuf, inBuf + n, '\r');
+            if (end == inBuf) continue;
+            setg(inBuf, inBuf, end);
+            return traits_type::to_int_type(inBuf[0]);
+        }
+    }
+
+    int overflow(int ch) override {
+        if (!sendPending()) return traits_type::eof();
+        if (ch != traits_type::eof()) {
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+    int sync() override { return sendPending() ? 0 : -1; }
+
+public:
+    SocketBuf(int socketFd) {
+        fd = socketFd;
+        setg(inBuf, inBuf, inBuf);
+        setp(outBuf, outBuf + sizeof(outBuf));
+    }
+};
+#endif
+
+// ==========================================
+// 2. SYSTEM MANAGER (MAIN CONTROLLER)
+// ==========================================
+
+class Marketplace {
+private:
+    // Main Databases
+    // DATA STRUCTURE: VECTOR
+    // Reason: Efficient random access (indexing) and dynamic resizing.
+    vector<Seller> sellers;
+    vector<Customer> customers; // Resident customers only (see CustomerShard); evicted rows leave free slots
+    ProductStore products; // Column store: see ProductStore
+
+    // Lookup Indexes (kept in sync by addSeller / addCustomer / addProduct)
+    // DATA STRUCTURE: HASH MAP
+    // Reason: O(1) login and id lookups instead of a linear search through the vectors.
+    // Their nodes come from pools (large blocks) instead of a heap allocation per row; one pool per
+    // table, so loadData() can build the three tables' indexes on separate threads.
+    // Note: The pools are not thread-safe; the maps only change with catalogLock held exclusively.
+    pmr::unsynchronized_pool_resource sellerNodes, customerNodes, productNodes;
+    pmr::unordered_map<int, int> sellerIndex{&sellerNodes};     // Seller ID   -> position in sellers
+    pmr::unordered_map<int, int> customerIndex{&customerNodes}; // Customer ID -> position in customers (resident rows)
+    pmr::unordered_map<int, int> productIndex{&productNodes};   // Product ID  -> position in products
+    pmr::unordered_map<string_view, int> sellerEmailIndex{&sellerNodes}; // Keys view sellerStrings
+
+    // Text of every seller row (customers keep theirs per shard, products in ProductStore)
+    StringPool sellerStrings;
+
+    // --- CUSTOMER SHARDS ---
+    // customers.txt and carts.txt are split by id range: shard k holds ids [k * CUSTOMER_SHARD_SIZE,
+    // (k + 1) * CUSTOMER_SHARD_SIZE) in customers.<k>.txt and carts.<k>.txt. A shard's rows are read on
+    // first use (login, a batch command, a journal record) and evicted again, least recently used first,
+    // once more than RESIDENT_CUSTOMER_LIMIT rows are in memory.
+    // Reason: Most customers never log in during a run; memory now follows the active ones, not the user base.
+    // Only the email index below covers every customer, at one hash and one id each.
+    // Note: The binary snapshot holds every row in one file, so with it all shards stay resident.
+    static constexpr int CUSTOMER_SHARD_SIZE = 1024;
+    static constexpr int RESIDENT_CUSTOMER_LIMIT = 1 << 15;
+    static constexpr int FREE_CUSTOMER_SLOT = -1; // id of an evicted row's slot in customers
+    struct CustomerShard {
+        bool resident = false;
+        int pins = 0;               // Sessions logged in as one of its customers: never evicted while > 0
+        uint64_t lastUsed = 0;      // customerClock at the last load / login
+        long long savedTicket = 0;  // Journal ticket of the last rewrite of its files (see Journal::written)
+        vector<int> rows;           // Positions in customers
+        unique_ptr<StringPool> strings; // Text of its rows, freed with them
+        vector<bool> savedIds;      // Ids in its customers file, by offset in the shard (from loadData, for reserveCartStock)
+    };
+    vector<CustomerShard> customerShards; // Shard number -> state
+    vector<int> freeCustomerSlots;
+    int residentCustomers = 0;
+    uint64_t customerClock = 0;
+
+    // DATA STRUCTURE: HASH MULTIMAP (email hash -> customer id), over every customer, resident or not
+    // Reason: Login finds the one shard to load without keeping any email text in memory. Hashes can
+    // collide, so the loaded row's email is always compared (see loadCustomerByEmail).
+    pmr::unordered_multimap<size_t, int> customerEmailIds{&customerNodes};
+    // Note: Shards, slots and the email index only change with catalogLock held exclusively.
+
+    // Products by rating, updated in place by addProduct / rateProduct
+    RatingIndex ratingIndex;
+
+    // Products by price, updated by addProduct (prices only change under the exclusive catalogLock)
+    PriceIndex priceIndex;
+
+    // Product names by trigram, updated by addProduct
+    NameIndex nameIndex;
+
+    // Recent listings (see ResultCache), up to RESULT_CACHE_ROWS positions in total (~16 MB)
+    static constexpr size_t RESULT_CACHE_ROWS = 1 << 22;
+    ResultCache resultCache{RESULT_CACHE_ROWS};
+
+    // Interned category names and the products in each, updated by addProduct
+    CategoryTable categories;
+
+    // DATA STRUCTURE: POSTING LISTS (Hash Map seller ID -> product positions, ascending), updated by addProduct
+    // Reason: The seller dashboard reads one seller's products without scanning the catalog.
+    unordered_map<int, vector<int>> sellerProducts;
+
+    // Seller dashboard: products with fewer units than this on hand count as low on stock
+    static constexpr int LOW_STOCK = 5;
+
+    // ID Trackers (Auto-increment logic)
+    int productCounter = 1;
+    int sellerCounter = 1;
+    int customerCounter = 1;
+    int orderCounter = 1; // Next order id (continues from the last line of orders.txt)
+    mutex orderLock;      // Order ids are taken in the same order their lines reach orders.txt
+
+    // Session State lives in Session (one per logged-in user), not here
+
+    // --- CONCURRENCY ---
+    // Lock order (always taken in this order, so sessions never deadlock):
+    //   catalogLock -> customer stripe -> product stripe -> ratingLock
+    // catalogLock: shared for work on existing rows, exclusive for inserts (they may move the
+    // vectors and the name arena) and for compaction (it reads every table).
+    // DATA STRUCTURE: LOCK STRIPES (fixed array of mutexes, row position -> position % LOCK_STRIPES)
+    // Reason: A product's stripe guards its rating and orders its journal records, a customer's stripe
+    // guards the cart, so sessions on different rows run on different cores instead of queueing on one lock.
+    // Stock itself takes no lock: see ProductStore::reserve / commit.
+    // Note: The lock types are plain mutexes, or in metrics builds mutexes that report contention.
+    CatalogMutex catalogLock;
+    static constexpr int LOCK_STRIPES = 64;
+    StripeMutex productLocks[LOCK_STRIPES];
+    StripeMutex customerLocks[LOCK_STRIPES];
+    RatingMutex ratingLock; // RatingIndex is one set shared by every product
+
+    StripeMutex& productLock(int idx) { return productLocks[idx % LOCK_STRIPES]; }
+
+    // Locks the stripes of several products, each stripe once and in stripe order (so two batches never deadlock)
+    vector<unique_lock<StripeMutex>> lockProductStripes(const vector<int>& rows) {
+        vector<int> stripes;
+        for (int idx : rows) stripes.push_back(idx % LOCK_STRIPES);
+        sort(stripes.begin(), stripes.end());
+        stripes.erase(unique(stripes.begin(), stripes.end()), stripes.end());
+        vector<unique_lock<StripeMutex>> held;
+        for (int st : stripes) held.emplace_back(productLocks[st]);
+        return held;
+    }
+    StripeMutex& customerLock(int idx) { return customerLocks[idx % LOCK_STRIPES]; }
+
+    // Mutations since the last full save. Folded into the .txt files by compactData().
+    Journal journal{"journal.txt"};
+
+    // Completed orders (never compacted or rewritten)
+    static constexpr const char* ORDERS_FILE = "orders.txt";
+
+    // Compact once the journal outgrows the database itself, so a full rewrite is amortized O(1) per change
+    static constexpr int JOURNAL_COMPACT_MIN = 1000;
+
+    // Rows per screen in product listings
+    static constexpr int PAGE_SIZE = 10;
+
+    // Snapshot format in use: set when marketplace.bin was loaded (or by convertToBinary)
+    bool binarySnapshot = false;
+
+    // Tables changed since their snapshot file was last written (the text format rewrites only these)
+    atomic<int> dirtyTables{0};
+
+public:
+    // Table bits, as taken by captureSnapshot()
+    enum Table { SELLERS = 1, CUSTOMERS = 2, PRODUCTS = 4, CARTS = 8, ALL_TABLES = 15 };
+
+    // How long the background writer lets changes accumulate before writing them
+    static constexpr int DEFAULT_FLUSH_INTERVAL_MS = 100;
+
+    Marketplace(int flushIntervalMs = DEFAULT_FLUSH_INTERVAL_MS) {
+        // Load data on startup: the binary snapshot when there is one, otherwise the text files
+        journal.recover(); // First complete the last snapshot, if a crash interrupted it
+        binarySnapshot = loadBinarySnapshot();
+        if (!binarySnapshot) loadData();
+        orderCounter = OrderLog::lastId(ORDERS_FILE) + 1; // orders.txt is kept in either format
+        replayJournal(); // Re-apply changes made after the last full save
+        reserveCartStock();
+        journal.open(flushIntervalMs);
+    }
+
+    ~Marketplace() {
+        // Save data to files on exit (nothing to do if unchanged, unless the last save failed)
+        if (journal.size() > 0 || journal.hasSnapshotFailure()) compactData();
+        journal.close(); // Wait for the background writer to finish
+#ifdef MARKETPLACE_METRICS
+        Metrics::dump(cerr);
+#endif
+    }
+
+    // --- UTILITY: UI & INPUT HANDLING ---
+
+    // Clears the console screen for a clean UI
+    void clearScreen(Session& s) {
+        if (!s.console) {
+            s.out << "\033[2J\033[H"; // Remote terminal: ANSI clear + cursor home
+            return;
+        }
+        #ifdef _WIN32
+            system("cls");
+        #else
+            system("clear");
+        #endif
+    }
+
+    // Pauses execution to let user read messages
+    void pause(Session& s) {
+        s.out << "\nPress Enter to continue...";
+        s.in.ignore(numeric_limits<streamsize>::max(), '\n');
+        s.in.get();
+    }
+
+    // Robust Input: Prevents infinite loops if user enters text instead of numbers
+    // Throws SessionClosed once the input has ended (terminal closed / client disconnected).
+    int getIntInput(Session& s) {
+        int choice;
+        while (!(s.in >> choice)) {
+            if (s.in.eof()) throw SessionClosed();
+            s.out << "Invalid input. Please enter a number: ";
+            s.in.clear(); // Clear error flag
+            s.in.ignore(numeric_limits<streamsize>::max(), '\n'); // Discard bad input
+        }
+        return choice;
+    }
+
+    // --- INDEXED LOOKUPS ---
+    // Each returns the position in its vector, or -1 if not found.
+
+    static int countLookup(int idx) {
+        METRIC_ADD(idx == -1 ? Metrics::INDEX_MISSES : Metrics::INDEX_HITS, 1);
+        return idx;
+    }
+
+    int findSeller(int id) {
+        auto it = sellerIndex.find(id);
+        return countLookup(it == sellerIndex.end() ? -1 : it->second);
+    }
+
+    // Resident customers only: see loadCustomer
+    int findCustomer(int id) {
+        auto it = customerIndex.find(id);
+        return countLookup(it == customerIndex.end() ? -1 : it->second);
+    }
+
+    int findProduct(int id) {
+        auto it = productIndex.find(id);
+        return countLookup(it == productIndex.end() ? -1 : it->second);
+    }
+
+    int findSellerByEmail(const string& email) {
+        auto it = sellerEmailIndex.find(email);
+        return countLookup(it == sellerEmailIndex.end() ? -1 : it->second);
+    }
+
+    // Insert-or-update helpers. The only way rows enter the vectors, so the indexes never go stale.
+    // Logic: When two accounts share an email, the first registered one keeps it (same as the old linear search).
+
+    void addSeller(const Seller& row) {
+        Seller s(row.id, sellerStrings.store(row.name), sellerStrings.store(row.email)); // Keep our own copy of the text
+        int idx = findSeller(s.id);
+        if (idx == -1) {
+            idx = sellers.size();
+            sellers.push_back(s);
+            sellerIndex[s.id] = idx;
+        } else {
+            auto old = sellerEmailIndex.find(sellers[idx].email);
+            if (old != sellerEmailIndex.end() && old->second == idx) sellerEmailIndex.erase(old);
+            sellers[idx] = s;
+        }
+        sellerEmailIndex.emplace(s.email, idx);
+        if (s.id >= sellerCounter) sellerCounter = s.id + 1;
+    }
+
+    // Returns the row's position. 'indexEmail' is false for rows read back from a shard file,
+    // whose emails the index already holds.
+    // Note: The row's shard must be resident (see loadCustomerShard), or new.
+    int addCustomer(const Customer& row, bool indexEmail = true) {
+        CustomerShard& shard = residentShard(shardOf(row.id));
+        StringPool& text = *shard.strings;
+        Customer c(row.id, text.store(row.name), text.store(row.address), text.store(row.phone), text.store(row.email));
+        int idx = findCustomer(c.id);
+        if (idx == -1) {
+            if (freeCustomerSlots.empty()) {
+                idx = customers.size();
+                customers.push_back(c);
+            } else {
+                idx = freeCustomerSlots.back();
+                freeCustomerSlots.pop_back();
+                customers[idx] = c;
+            }
+            customerIndex[c.id] = idx;
+            shard.rows.push_back(idx);
+            residentCustomers++;
+        } else {
+            Customer& old = customers[idx]; // Profile update keeps the existing cart
+            if (indexEmail) unindexEmail(old.email, old.id);
+            old.name = c.name; old.address = c.address; old.phone = c.phone; old.email = c.email;
+        }
+        if (indexEmail) customerEmailIds.emplace(hash<string_view>()(c.email), c.id);
+        if (c.id >= customerCounter) customerCounter = c.id + 1;
+        return idx;
+    }
+
+    void unindexEmail(string_view email, int id) {
+        auto range = customerEmailIds.equal_range(hash<string_view>()(email));
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second == id) { customerEmailIds.erase(it); return; }
+        }
+    }
+
+    void addProduct(const Product& p) {
+        int idx = findProduct(p.id);
+        if (idx == -1) {
+            idx = products.size();
+            productIndex[p.id] = idx;
+            products.push_back(p);
+            nameIndex.add(idx, p.name);
+            categories.addProduct(p.categoryId, idx);
+            sellerProducts[p.sellerId].push_back(idx); // Positions only grow: the list stays sorted
+        } else {
+            ratingIndex.erase(idx, products.averageRating(idx));
+            priceIndex.erase(idx, products.price[idx]);
+            if (products.name(idx) != p.name) {
+                nameIndex.remove(idx, products.name(idx));
+                nameIndex.add(idx, p.name);
+            }
+            if (products.categoryId[idx] != p.categoryId) {
+                categories.removeProduct(products.categoryId[idx], idx);
+                categories.addProduct(p.categoryId, idx);
+            }
+            if (products.sellerId[idx] != p.sellerId) {
+                vector<int>& from = sellerProducts[products.sellerId[idx]];
+                from.erase(lower_bound(from.begin(), from.end(), idx));
+                vector<int>& to = sellerProducts[p.sellerId];
+                to.insert(lower_bound(to.begin(), to.end(), idx), idx);
+            }
+            products.set(idx, p);
+        }
+        ratingIndex.insert(idx, p.getAverageRating());
+        priceIndex.insert(idx, p.price);
+        if (p.id >= productCounter) productCounter = p.id + 1;
+    }
+
+    // Records a customer rating and moves the product to its new place in the ranking (O(log n))
+    // Note: Caller holds the product's stripe and ratingLock.
+    void rateProduct(int idx, double rate) {
+        ratingIndex.erase(idx, products.averageRating(idx));
+        products.addRating(idx, rate);
+        ratingIndex.insert(idx, products.averageRating(idx));
+    }
+
+    // Applies a batch of (product position, stars) ratings: the locks are taken once for the whole
+    // batch and the new rows are saved as one journal group.
+    void rateProducts(const vector<pair<int, int>>& ratings) {
+        if (ratings.empty()) return;
+        vector<int> rows;
+        for (const auto& r : ratings) rows.push_back(r.first);
+
+        shared_lock<CatalogMutex> catalog(catalogLock);
+        auto stripes = lockProductStripes(rows);
+        vector<string> records;
+        {
+            lock_guard<RatingMutex> ranking(ratingLock);
+            for (const auto& r : ratings) rateProduct(r.first, r.second);
+        }
+        sort(rows.begin(), rows.end());
+        rows.erase(unique(rows.begin(), rows.end()), rows.end());
+        for (int idx : rows) records.push_back(productEntry(idx));
+        journal.appendGroup(records);
+        dirtyTables |= PRODUCTS;
+    }
+
+    // --- CUSTOMER SHARDS: LAZY LOADING ---
+    // Note: Everything here needs catalogLock held exclusively (rows move in and out of customers).
+
+    static int shardOf(int customerId) { return customerId / CUSTOMER_SHARD_SIZE; }
+
+    // "customers" / "carts" + shard number -> file name, e.g. "carts.3.txt"
+    static string shardFile(const char* table, int shard) { return string(table) + "." + to_string(shard) + ".txt"; }
+
+    // The shard's state, made resident if it was not (without reading anything: for new or restored rows)
+    CustomerShard& residentShard(int k) {
+        if (k >= (int)customerShards.size()) customerShards.resize(k + 1);
+        CustomerShard& shard = customerShards[k];
+        if (!shard.resident) {
+            shard.resident = true;
+            shard.strings = make_unique<StringPool>();
+            shard.lastUsed = ++customerClock;
+        }
+        return shard;
+    }
+
+    // Reads shard k's customers and carts from its files, unless it is already resident
+    // Logic: Saved stock already counts these carts (see reserveCartStock), so nothing is reserved again.
+    void loadCustomerShard(int k, bool evict = true) {
+        if (k < (int)customerShards.size() && customerShards[k].resident) return;
+        if (evict) evictColdCustomers();
+        residentShard(k);
+        if (binarySnapshot) return; // Every row came from marketplace.bin: a shard missing there is empty
+        METRIC_TIMER(LOAD_SHARD);
+        vector<string_view> f;
+        MappedFile cFile(shardFile("customers", k)), cartFile(shardFile("carts", k));
+        if (cFile.isOpen()) {
+            T::forEachLine(cFile.view(), [&](string_view line) {
+                T::split(line, f);
+                CustomerRow r;
+                if (CustomerFormat::readText(f, 0, r) && shardOf(r.id) == k) addCustomer(customerOf(r), false);
+            });
+        }
+        if (cartFile.isOpen()) {
+            T::forEachLine(cartFile.view(), [&](string_view line) {
+                T::split(line, f);
+                CartRow r;
+                if (!CartFormat::readText(f, 0, r) || shardOf(r.customerId) != k) return;
+                int cIdx = findCustomer(r.customerId);
+                if (cIdx != -1) pushCartItem(customers[cIdx], r.productId, r.quantity);
+            });
+        }
+    }
+
+    // Position of customer 'id', loading its shard if needed; -1 if there is no such customer
+    int loadCustomer(int id) {
+        if (id < 0 || id >= customerCounter) return countLookup(-1);
+        loadCustomerShard(shardOf(id));
+        return findCustomer(id);
+    }
+
+    // Position of the customer with this email (the lowest id, if several share it), or -1
+    int loadCustomerByEmail(const string& email) {
+        vector<int> ids;
+        auto range = customerEmailIds.equal_range(hash<string_view>()(email));
+        for (auto it = range.first; it != range.second; ++it) ids.push_back(it->second);
+        sort(ids.begin(), ids.end());
+        for (int id : ids) {
+            int idx = loadCustomer(id);
+            if (idx != -1 && customers[idx].email == email) return idx;
+        }
+        return -1;
+    }
+
+    // Memory pressure: drops least recently used shards until a new one fits under RESIDENT_CUSTOMER_LIMIT.
+    // Only shards nobody is logged in to, with no unsaved row and whose last rewrite is on disk, can go:
+    // reading one back from its files then gives exactly the rows that were dropped.
+    void evictColdCustomers() {
+        if (binarySnapshot || residentCustomers + CUSTOMER_SHARD_SIZE <= RESIDENT_CUSTOMER_LIMIT) return;
+        vector<int> candidates;
+        for (int k = 0; k < (int)customerShards.size(); k++) {
+            const CustomerShard& shard = customerShards[k];
+            if (shard.resident && shard.pins == 0 && !hasUnsaved(shard) && journal.written(shard.savedTicket)) candidates.push_back(k);
+        }
+        sort(candidates.begin(), candidates.end(), [&](int a, int b) { return customerShards[a].lastUsed < customerShards[b].lastUsed; });
+        for (int k : candidates) {
+            if (residentCustomers + CUSTOMER_SHARD_SIZE <= RESIDENT_CUSTOMER_LIMIT) break;
+            CustomerShard& shard = customerShards[k];
+            for (int idx : shard.rows) {
+                customerIndex.erase(customers[idx].id);
+                customers[idx] = Customer(FREE_CUSTOMER_SLOT, {}, {}, {}, {}); // Frees the cart as well
+                freeCustomerSlots.push_back(idx);
+            }
+            residentCustomers -= shard.rows.size();
+            shard.rows = vector<int>();
+            shard.strings.reset();
+            shard.resident = false;
+        }
+    }
+
+    bool hasUnsaved(const CustomerShard& shard) const {
+        for (int idx : shard.rows) if (customers[idx].unsaved) return true;
+        return false;
+    }
+
+    // A logged-in customer's shard stays resident until logout
+    void pinCustomer(int idx, int delta) {
+        CustomerShard& shard = customerShards[shardOf(customers[idx].id)];
+        shard.pins += delta;
+        shard.lastUsed = ++customerClock;
+    }
+
+    // --- NEW ACCOUNTS & PRODUCTS ---
+    // Shared by the menus and batch mode. Each saves the new row and returns its id.
+
+    int createSeller(const string& name, const string& email) {
+        unique_lock<CatalogMutex> catalog(catalogLock); // Inserts may move the vectors
+        addSeller(Seller(sellerCounter, name, email));
+        journalSeller(sellers.back());
+        return sellers.back().id;
+    }
+
+    int createCustomer(const string& name, const string& addr, const string& phone, const string& email) {
+        unique_lock<CatalogMutex> catalog(catalogLock);
+        int id = customerCounter;
+        loadCustomerShard(shardOf(id)); // The new row joins its shard's saved rows
+        journalCustomer(customers[addCustomer(Customer(id, name, addr, phone, email))]);
+        return id;
+    }
+
+    int createProduct(int sellerIdx, const string& name, const string& cat, double price, int qty) {
+        unique_lock<CatalogMutex> catalog(catalogLock);
+        addProduct(Product(productCounter, name, price, categories.intern(cat), qty, sellers[sellerIdx].id));
+        journalProduct(products.size() - 1);
+        return products.id[products.size() - 1];
+    }
+
+    // --- FILE I/O OPERATIONS ---
+
+    // Record Formatting: one pipe-delimited line per row, shared by the snapshot files and the journal
+    // Logic: Each record is appended to 'out', so writing a whole table allocates only when 'out' grows.
+    typedef TextRecord T;
+
+    // Rows as their *Format writers take them (views only, nothing is copied)
+    static SellerRow sellerRow(const Seller& s) { return SellerRow{s.id, s.name, s.email}; }
+    static CustomerRow customerRow(const Customer& c) { return CustomerRow{c.id, c.name, c.address, c.phone, c.email}; }
+    ProductRow productRow(int idx) {
+        const ProductStore& p = products;
+        return ProductRow{p.id[idx], p.name(idx), p.price[idx], categories.name(p.categoryId[idx]), p.onHand(idx),
+                          p.sellerId[idx], p.ratingSum[idx], p.ratingCount[idx]};
+    }
+
+    void sellerRecord(string& out, const Seller& s) { SellerFormat::writeText(out, sellerRow(s)); }
+    void customerRecord(string& out, const Customer& c) { CustomerFormat::writeText(out, customerRow(c)); }
+    void productRecord(string& out, int idx) { ProductFormat::writeText(out, productRow(idx)); }
+
+    // Format: CustomerID|ProductID|Quantity|ProductID|Quantity... (bottom of the stack first)
+    void cartRecord(string& out, const Customer& c) {
+        T::writeInt(out, c.id);
+        c.cart.forEach([&](const CartItem& item) {
+            out += '|'; T::writeInt(out, item.productId);
+            out += '|'; T::writeInt(out, item.buyQty);
+        });
+    }
+
+    // Journal record: type letter, '|', then the row in the same format as its table file
+    template <typename F>
+    static string journalRecord(char type, F writeRow) {
+        string out(1, type);
+        out += '|';
+        writeRow(out);
+        return out;
+    }
+
+    // --- JOURNAL: INCREMENTAL SAVES ---
+    // Each mutation appends a single record. Save cost depends on the size of the change, not the database.
+
+    // The record is handed to the background writer; these return without touching the disk.
+    // Note: Caller holds the lock that guards the row, so records of one row reach the journal in order.
+    void journalSeller(const Seller& s) { journal.append(sellerEntry(s)); dirtyTables |= SELLERS; }
+    void journalCustomer(Customer& c) { journal.append(customerEntry(c)); c.unsaved = true; dirtyTables |= CUSTOMERS; }
+    void journalProduct(int idx) { journal.append(productEntry(idx)); dirtyTables |= PRODUCTS; }
+    void journalCart(Customer& c) { journal.append(cartEntry(c)); c.unsaved = true; dirtyTables |= CARTS; }
+
+    string sellerEntry(const Seller& s) { return journalRecord('S', [&](string& out) { sellerRecord(out, s); }); }
+    string customerEntry(const Customer& c) { return journalRecord('C', [&](string& out) { customerRecord(out, c); }); }
+    string productEntry(int idx) { return journalRecord('P', [&](string& out) { productRecord(out, idx); }); }
+    string cartEntry(const Customer& c) { return journalRecord('K', [&](string& out) { cartRecord(out, c); }); }
+
+    // Called between user actions, while holding no lock
+    void maybeCompact() {
+        if (journal.size() < JOURNAL_COMPACT_MIN) return; // Cheap check first: no lock on the common path
+        unique_lock<CatalogMutex> guard(catalogLock);
+        int rows = sellers.size() + customerEmailIds.size() + products.size();
+        if (journal.size() >= max(JOURNAL_COMPACT_MIN, rows)) compactData();
+    }
+
+    // Folds the journal into the snapshot files. The journal is only cleared once the snapshot is written.
+    // Logic: Only the point-in-time copy is taken here (caller holds catalogLock exclusively, or is alone);
+    // the background writer formats it and does the disk I/O, in journal order.
+    // Returns the snapshot's ticket (see Journal::written)
+    long long compactData() {
+        METRIC_TIMER(COMPACT);
+        if (journal.takeSnapshotFailure()) {
+            // An earlier snapshot never reached the disk: its tables and shards would otherwise stay stale
+            dirtyTables = ALL_TABLES;
+            for (Customer& c : customers) c.unsaved = c.id != FREE_CUSTOMER_SLOT;
+        }
+        shared_ptr<const TableSnapshot> view = captureSnapshot(binarySnapshot ? ALL_TABLES : int(dirtyTables));
+        long long ticket = journal.replaceSnapshot([view] {
+            if (!view->binary) return saveData(*view);
+            return vector<pair<string, string>>{{"marketplace.bin", saveBinarySnapshot(*view)}};
+        });
+        dirtyTables = 0;
+        // The shards just serialized are clean again once the writer has their files on disk
+        for (CustomerShard& shard : customerShards) {
+            if (!shard.resident || !hasUnsaved(shard)) continue;
+            for (int idx : shard.rows) customers[idx].unsaved = false;
+            shard.savedTicket = ticket;
+        }
+        return ticket;
+    }
+
+    // --- FORMAT CONVERTER ---
+
+    // Writes the current data as marketplace.bin; later saves keep using the binary format
+    void convertToBinary() {
+        for (int k = 0; k < (int)customerShards.size(); k++) loadCustomerShard(k, false); // It holds every row
+        binarySnapshot = true;
+        compactData();
+    }
+
+    // Writes the current data as the .txt files and retires marketplace.bin
+    // Returns false (keeping marketplace.bin and the binary format) if the text files could not be written.
+    bool convertToText() {
+        binarySnapshot = false;
+        dirtyTables = ALL_TABLES;
+        for (Customer& c : customers) c.unsaved = c.id != FREE_CUSTOMER_SLOT; // Every shard file is written
+        long long ticket = compactData();
+        journal.sync(); // The text files must be in place before the binary snapshot goes
+        if (!journal.written(ticket)) {
+            binarySnapshot = true;
+            cerr << "[ERROR] Could not write the text files; marketplace.bin is kept.\n";
+            return false;
+        }
+        remove("marketplace.bin");
+        return true;
+    }
+
+    // Copies the rows behind the given tables (Table bits): what saveData / saveBinarySnapshot write
+    // Logic: In the binary format every table and customer shard is copied; the text format takes only
+    // the shards with an unsaved row (the others are unchanged on disk).
+    // Note: Caller holds catalogLock exclusively (or runs alone), so no stock, rating or cart moves meanwhile.
+    unique_ptr<TableSnapshot> captureSnapshot(int tables) {
+        unique_ptr<TableSnapshot> view(new TableSnapshot());
+        view->binary = binarySnapshot;
+        view->tables = tables;
+
+        if (tables & SELLERS) {
+            view->sellers.reserve(sellers.size());
+            for (const auto& s : sellers) view->sellers.push_back(sellerRow(s));
+        }
+
+        // Rows keep the order they joined their shard in (file order, then new registrations)
+        if (tables & (CUSTOMERS | CARTS)) {
+            for (int k = 0; k < (int)customerShards.size(); k++) {
+                const CustomerShard& shard = customerShards[k];
+                if (!shard.resident || (!binarySnapshot && !hasUnsaved(shard))) continue;
+                view->shards.push_back(TableSnapshot::Shard{k, {}, {}});
+                TableSnapshot::Shard& out = view->shards.back();
+                out.customers.reserve(shard.rows.size());
+                for (int idx : shard.rows) {
+                    const Customer& c = customers[idx];
+                    out.customers.push_back(customerRow(c));
+                    c.cart.forEach([&](const CartItem& item) { out.carts.push_back(CartRow{c.id, item.productId, item.buyQty}); });
+                }
+            }
+        }
+
+        if (tables & PRODUCTS) {
+            view->products.reserve(products.size());
+            view->productCategories.reserve(products.size());
+            for (int i = 0; i < products.size(); i++) {
+                view->products.push_back(productRow(i));
+                view->products.back().name = view->productNames.store(products.name(i));
+                view->productCategories.push_back(products.categoryId[i]);
+            }
+            for (int i = 0; i < categories.size(); i++) view->categories.push_back(categories.name(i));
+        }
+        return view;
+    }
+
+    // --- BINARY SNAPSHOT ---
+
+    // Serializes a snapshot of the whole database as the contents of marketplace.bin
+    static string saveBinarySnapshot(const TableSnapshot& view) {
+        typedef BinarySnapshot B;
+        string heap;
+        auto ref = [&heap](string_view str) {
+            B::StrRef r{uint32_t(heap.size()), uint32_t(str.size())};
+            heap.append(str.data(), str.size());
+            return r;
+        };
+        vector<B::StrRef> categoryRefs; // Each category name is stored once
+        for (string_view name : view.categories) categoryRefs.push_back(ref(name));
+
+        uint32_t customerCount = 0, cartCount = 0;
+        for (const auto& shard : view.shards) {
+            customerCount += shard.customers.size();
+            cartCount += shard.carts.size();
+        }
+        string body;
+        body.reserve(view.sellers.size() * SellerFormat::BINARY_SIZE + customerCount * CustomerFormat::BINARY_SIZE +
+                     view.products.size() * ProductFormat::BINARY_SIZE + cartCount * CartFormat::BINARY_SIZE);
+        for (const SellerRow& r : view.sellers) SellerFormat::writeBinary(body, r, ref);
+        for (const auto& shard : view.shards)
+            for (const CustomerRow& r : shard.customers) CustomerFormat::writeBinary(body, r, ref);
+        for (size_t i = 0; i < view.products.size(); i++) {
+            const ProductRow& row = view.products[i];
+            B::StrRef category = categoryRefs[view.productCategories[i]];
+            ProductFormat::writeBinary(body, row, [&](string_view str) {
+                return str.data() == row.category.data() ? category : ref(str); // The category text is in the heap already
+            });
+        }
+        for (const auto& shard : view.shards)
+            for (const CartRow& r : shard.carts) CartFormat::writeBinary(body, r, ref);
+        body += heap;
+
+        B::Header h;
+        memcpy(h.magic, B::MAGIC, sizeof(h.magic));
+        h.version = B::VERSION;
+        h.sellerCount = view.sellers.size();
+        h.customerCount = customerCount;
+        h.productCount = view.products.size();
+        h.cartCount = cartCount;
+        h.reserved = 0;
+        h.heapSize = heap.size();
+        h.checksum = B::checksum(body.data(), body.size());
+
+        string out;
+        out.reserve(sizeof(h) + body.size());
+        B::write(out, h);
+        out += body;
+        return out;
+    }
+
+    // Maps marketplace.bin and loads it. Returns false (having loaded nothing) if it is missing or invalid.
+    bool loadBinarySnapshot() {
+        typedef BinarySnapshot B;
+        MappedFile file("marketplace.bin");
+        if (!file.isOpen()) return false;
+        string_view data = file.view();
+
+        // Validate before touching any table
+        if (data.size() < sizeof(B::Header)) return false;
+        const char* at = data.data();
+        B::Header h = B::read<B::Header>(at);
+        if (memcmp(h.magic, B::MAGIC, sizeof(h.magic)) != 0 || h.version != B::VERSION) {
+            cerr << "[WARNING] marketplace.bin has an unknown format; loading the text files instead.\n";
+            return false;
+        }
+        uint64_t expected = uint64_t(h.sellerCount) * SellerFormat::BINARY_SIZE + uint64_t(h.customerCount) * CustomerFormat::BINARY_SIZE +
+                            uint64_t(h.productCount) * ProductFormat::BINARY_SIZE + uint64_t(h.cartCount) * CartFormat::BINARY_SIZE + h.heapSize;
+        if (data.size() - sizeof(B::Header) != expected || B::checksum(at, expected) != h.checksum) {
+            cerr << "[WARNING] marketplace.bin is damaged; loading the text files instead.\n";
+            return false;
+        }
+
+        const char* heap = data.data() + data.size() - h.heapSize;
+        auto str = [heap](const B::StrRef& r) { return string_view(heap + r.offset, r.length); };
+
+        sellers.reserve(h.sellerCount); sellerIndex.reserve(h.sellerCount); sellerEmailIndex.reserve(h.sellerCount);
+        for (uint32_t i = 0; i < h.sellerCount; i++) {
+            SellerRow r;
+            SellerFormat::readBinary(at, r, str);
+            addSellerRow(r);
+        }
+        customers.reserve(h.customerCount); customerIndex.reserve(h.customerCount); customerEmailIds.reserve(h.customerCount);
+        for (uint32_t i = 0; i < h.customerCount; i++) {
+            CustomerRow r;
+            CustomerFormat::readBinary(at, r, str);
+            addCustomer(customerOf(r));
+        }
+        products.reserve(h.productCount, h.heapSize); productIndex.reserve(h.productCount);
+        for (uint32_t i = 0; i < h.productCount; i++) {
+            ProductRow r;
+            ProductFormat::readBinary(at, r, str);
+            addProductRow(r);
+        }
+        for (uint32_t i = 0; i < h.cartCount; i++) {
+            CartRow r;
+            CartFormat::readBinary(at, r, str);
+            int cIdx = findCustomer(r.customerId);
+            if (cIdx != -1) pushCartItem(customers[cIdx], r.productId, r.quantity);
+        }
+        return true;
+    }
+
+    // Re-applies journal records over the loaded snapshot (upsert by id)
+    void replayJournal() {
+        MappedFile jFile("journal.txt");
+        if (!jFile.isOpen()) return;
+
+        // A last line without its newline was cut off mid-write: ignore it
+        string_view text = jFile.view();
+        if (!text.empty() && text.back() != '\n') text = text.substr(0, text.rfind('\n') + 1);
+
+        vector<string_view> f;
+        vector<string_view> group; // Lines of the "B|<count>" group being read
+        size_t groupSize = 0;
+        int count = 0;
+        TextRecord::forEachLine(text, [&](string_view line) {
+            count++;
+            if (groupSize > 0) {
+                group.push_back(line);
+                if (group.size() < groupSize) return;
+                for (string_view record : group) replayRecord(record, f);
+                group.clear();
+                groupSize = 0;
+                return;
+            }
+            int n;
+            if (line.size() > 2 && line.substr(0, 2) == "B|" && TextRecord::toInt(line.substr(2), n) && n > 0) {
+                groupSize = n;
+                return;
+            }
+            replayRecord(line, f);
+        });
+        // An unfinished group at the end was never completely written: none of it is applied
+        journal.setSize(count);
+    }
+
+    // Applies one journal record (see journalSeller and friends for the types)
+    // 'f' is scratch space for the split fields
+    void replayRecord(string_view line, vector<string_view>& f) {
+        TextRecord::split(line, f);
+        if (f.size() < 2) return;
+        string_view type = f[0];
+        if (type == "S") { addSellerRecord(f, 1); dirtyTables |= SELLERS; }
+        else if (type == "C") { addCustomerRecord(f, 1); dirtyTables |= CUSTOMERS; }
+        else if (type == "P") { addProductRecord(f, 1); dirtyTables |= PRODUCTS; }
+        else if (type == "K") {
+            dirtyTables |= CARTS;
+            // Full cart state: the customer's stack is replaced, not appended to
+            int cid;
+            if (!TextRecord::toInt(f[1], cid)) return;
+            int cIdx = loadCustomer(cid);
+            if (cIdx == -1) return;
+            Customer& c = customers[cIdx];
+            c.unsaved = true;
+            c.cart.clear();
+            for (size_t i = 2; i + 1 < f.size(); i += 2) {
+                int pid, qty;
+                if (TextRecord::toInt(f[i], pid) && TextRecord::toInt(f[i + 1], qty)) pushCartItem(c, pid, qty);
+            }
+        }
+        else if (type == "O") {
+            // Order line: already in orders.txt unless the process died between the two writes
+            int id;
+            if (!TextRecord::toInt(f[1], id) || id < orderCounter) return;
+            ofstream log(ORDERS_FILE, ios::app);
+            log << line.substr(2) << '\n';
+            orderCounter = id + 1;
+        }
     }
-};
 
-// ==========================================
-// 2. SYSTEM MANAGER (MAIN CONTROLLER)
-// ==========================================
+    // Record Parsing: rows come from the *Format parsers (see RecordFormat), shared by the snapshot
+    // loaders and the journal replay. Malformed rows are skipped.
 
-class Marketplace {
-private:
-    // Main Databases
-    // DATA STRUCTURE: VECTOR
-    // Reason: Efficient random access (indexing) and dynamic resizing.
-    vector<Seller> sellers;
-    vector<Customer> customers;
-    vector<Product> products;
+    void addSellerRow(const SellerRow& r) { addSeller(Seller(r.id, r.name, r.email)); }
+    Customer customerOf(const CustomerRow& r) { return Customer(r.id, r.name, r.address, r.phone, r.email); }
 
-    // ID Trackers (Auto-increment logic)
-    int productCounter = 1;
-    int sellerCounter = 1;
-    int customerCounter = 1;
+    void addProductRow(const ProductRow& r) {
+        addProduct(Product(r.id, r.name, r.price, categories.intern(r.category), r.quantity, r.sellerId, r.ratingSum, r.ratingCount));
+    }
 
-    // Session State (Stores index of currently logged-in user)
-    int currentSellerIdx = -1;
-    int currentCustomerIdx = -1;
+    // Journal replay: one record at a time; 'at' is the position of the id field
 
-public:
-    Marketplace() {
-        loadData(); // Load data from files on startup
+    void addSellerRecord(const vector<string_view>& f, size_t at) {
+        SellerRow r;
+        if (SellerFormat::readText(f, at, r)) addSellerRow(r);
     }
 
-    ~Marketplace() {
-        saveData(); // Save data to files on exit
+    // The customer's shard is loaded first: the record updates its saved row, or joins the shard
+    void addCustomerRecord(const vector<string_view>& f, size_t at) {
+        CustomerRow r;
+        if (!CustomerFormat::readText(f, at, r) || r.id < 0) return;
+        loadCustomerShard(shardOf(r.id));
+        customers[addCustomer(customerOf(r))].unsaved = true;
     }
 
-    // --- UTILITY: UI & INPUT HANDLING ---
-
-    // Clears the console screen for a clean UI
-    void clearScreen() {
-        #ifdef _WIN32
-            system("cls");
-        #else
-            system("clear");
-        #endif
+    void addProductRecord(const vector<string_view>& f, size_t at) {
+        ProductRow r;
+        if (ProductFormat::readText(f, at, r)) addProductRow(r);
     }
 
-    // Pauses execution to let user read messages
-    void pause() {
-        cout << "\nPress Enter to continue...";
-        cin.ignore(numeric_limits<streamsize>::max(), '\n');
-        cin.get();
+    // Pushes a cart line if the product still exists
+    void pushCartItem(Customer& c, int pid, int qty) {
+        if (findProduct(pid) == -1) return;
+        c.cart.add(pid, qty);
     }
 
-    // Robust Input: Prevents infinite loops if user enters text instead of numbers
-    int getIntInput() {
-        int choice;
-        while (!(cin >> choice)) {
-            cout << "Invalid input. Please enter a number: ";
-            cin.clear(); // Clear error flag
-            cin.ignore(numeric_limits<streamsize>::max(), '\n'); // Discard bad input
+    // Saved stock is on-hand stock, so the reservations of saved carts are taken again after loading.
+    // Logic: Resident carts are read from memory; the shards not loaded have their cart files scanned
+    // in parallel, keeping exactly the lines loadCustomerShard would (known customer, existing product).
+    // Which customers a shard file holds was noted by loadData, so no customers file is read twice.
+    void reserveCartStock() {
+        products.clearReservations();
+        vector<int> cold;
+        for (int k = 0; k < (int)customerShards.size(); k++) {
+            const CustomerShard& shard = customerShards[k];
+            if (!shard.resident) { cold.push_back(k); continue; }
+            for (int idx : shard.rows) {
+                customers[idx].cart.forEach([&](const CartItem& item) { products.holdForCart(findProduct(item.productId), item.buyQty); });
+            }
         }
-        return choice;
+        if (!binarySnapshot) {
+            parallelFor(cold.size(), [&](int t) {
+                int k = cold[t];
+                const vector<bool>& known = customerShards[k].savedIds;
+                MappedFile cartFile(shardFile("carts", k));
+                if (known.empty() || !cartFile.isOpen()) return;
+                vector<string_view> f;
+                T::forEachLine(cartFile.view(), [&](string_view line) {
+                    T::split(line, f);
+                    CartRow r;
+                    if (!CartFormat::readText(f, 0, r) || shardOf(r.customerId) != k || !known[r.customerId % CUSTOMER_SHARD_SIZE]) return;
+                    int pIdx = findProduct(r.productId);
+                    if (pIdx != -1) products.holdForCart(pIdx, r.quantity);
+                });
+            });
+        }
+        for (CustomerShard& shard : customerShards) vector<bool>().swap(shard.savedIds); // Only needed here
     }
 
-    // --- FILE I/O OPERATIONS ---
+    // Serializes a snapshot (see captureSnapshot) into the contents of its text files
+    // Logic: Built in memory with '\n' line ends; no per-line flushing. Runs on the background writer:
+    // it reads nothing but the snapshot.
+    static vector<pair<string, string>> saveData(const TableSnapshot& view) {
+        METRIC_TIMER(SAVE_DATA);
+        vector<pair<string, string>> files;
+        auto table = [&files](string name, const auto& rows, auto writeText) {
+            string out;
+            for (const auto& r : rows) { writeText(out, r); out += '\n'; }
+            files.emplace_back(move(name), move(out));
+        };
 
-    // Writes all runtime data to text files
-    void saveData() {
         // 1. Save Sellers
-        ofstream sFile("sellers.txt");
-        for (const auto& s : sellers) sFile << s.id << "|" << s.name << "|" << s.email << endl;
+        if (view.tables & SELLERS) table("sellers.txt", view.sellers, SellerFormat::writeText);
 
-        // 2. Save Customers
-        ofstream cFile("customers.txt");
-        for (const auto& c : customers) cFile << c.id << "|" << c.name << "|" << c.address << "|" << c.phone << "|" << c.email << endl;
+        // 2. Save Customers: one file per shard in the snapshot
+        if (view.tables & CUSTOMERS) {
+            for (const auto& shard : view.shards) table(shardFile("customers", shard.number), shard.customers, CustomerFormat::writeText);
+        }
 
         // 3. Save Products
-        ofstream pFile("products.txt");
-        for (const auto& p : products) {
-            pFile << p.id << "|" << p.name << "|" << p.price << "|" << p.category << "|"
-                  << p.quantity << "|" << p.sellerId << "|" << p.ratingSum << "|" << p.ratingCount << endl;
-        }
+        if (view.tables & PRODUCTS) table("products.txt", view.products, ProductFormat::writeText);
 
         // 4. Save Carts (Persisting the Stack)
         // Format: CustomerID|ProductID|Quantity
-        ofstream cartFile("carts.txt");
-        for (const auto& c : customers) {
-            if (!c.cartStack.empty()) {
-                // Copy stack to temporary stack to read without destroying original
-                stack<CartItem> tempStack = c.cartStack;
-                while(!tempStack.empty()) {
-                    CartItem item = tempStack.top();
-                    tempStack.pop();
-                    cartFile << c.id << "|" << item.product.id << "|" << item.buyQty << endl;
-                }
-            }
+        // Written bottom of the stack first, so loading (which pushes in file order) keeps the same top
+        if (view.tables & CARTS) {
+            for (const auto& shard : view.shards) table(shardFile("carts", shard.number), shard.carts, CartFormat::writeText);
         }
+        return files;
     }
 
     // Reads data from text files into Vectors
+    // Logic: Each file is memory-mapped and parsed in place, in three phases:
+    //   1. Sellers and products are cut into line-aligned chunks, and every chunk of both tables is
+    //      parsed on the thread pool into row values (no shared state is touched).
+    //   2. Each table's rows go into its vector and indexes on a thread of its own, in file order
+    //      (the tables share no container: see the per-table index pools).
+    //   3. Customers and carts stay on disk: only the email index is built, from every customer shard
+    //      in parallel (see CUSTOMER SHARDS). Files from before sharding are split up first.
     void loadData() {
-        string line;
+        METRIC_TIMER(LOAD_DATA);
+        MappedFile sFile("sellers.txt"), pFile("products.txt");
+        auto chunksOf = [](const MappedFile& file) {
+            return file.isOpen() ? T::splitChunks(file.view(), T::parseThreads(file.view().size())) : vector<string_view>();
+        };
 
-        // 1. Load Sellers
-        ifstream sFile("sellers.txt");
-        if(sFile.is_open()) {
-            while (getline(sFile, line)) {
-                stringstream ss(line); string segment; vector<string> data;
-                while(getline(ss, segment, '|')) data.push_back(segment);
-                if(data.size() >= 3) {
-                    int id = stoi(data[0]);
-                    sellers.push_back(Seller(id, data[1], data[2]));
-                    if (id >= sellerCounter) sellerCounter = id + 1;
-                }
-            }
-        }
+        // 1. Parse
+        vector<string_view> sChunks = chunksOf(sFile), pChunks = chunksOf(pFile);
+        vector<vector<SellerRow>> sRows(sChunks.size());
+        vector<vector<ProductRow>> pRows(pChunks.size());
+        int sTasks = sChunks.size();
+        parallelFor(sTasks + pChunks.size(), [&](int task) {
+            // Parses one chunk into 'rows' with parse(fields, at, row); malformed lines are skipped
+            auto parseChunk = [](string_view chunk, auto& rows, auto parse) {
+                vector<string_view> f; // Field buffer, reused within the chunk
+                T::forEachLine(chunk, [&](string_view line) {
+                    T::split(line, f);
+                    rows.emplace_back();
+                    if (!parse(f, 0, rows.back())) rows.pop_back();
+                });
+            };
+            if (task < sTasks) parseChunk(sChunks[task], sRows[task], SellerFormat::readText);
+            else parseChunk(pChunks[task - sTasks], pRows[task - sTasks], ProductFormat::readText);
+        });
 
-        // 2. Load Customers
-        ifstream cFile("customers.txt");
-        if(cFile.is_open()) {
-            while (getline(cFile, line)) {
-                stringstream ss(line); string segment; vector<string> data;
-                while(getline(ss, segment, '|')) data.push_back(segment);
-                if(data.size() >= 5) {
-                    int id = stoi(data[0]);
-                    customers.push_back(Customer(id, data[1], data[2], data[3], data[4]));
-                    if (id >= customerCounter) customerCounter = id + 1;
-                }
+        // 2. Index: one table per task
+        auto total = [](const auto& chunks) {
+            size_t n = 0;
+            for (const auto& rows : chunks) n += rows.size();
+            return n;
+        };
+        parallelFor(2, [&](int table) {
+            if (table == 0) {
+                size_t n = total(sRows);
+                sellers.reserve(n); sellerIndex.reserve(n); sellerEmailIndex.reserve(n);
+                for (const auto& rows : sRows) for (const SellerRow& r : rows) addSellerRow(r);
+                sRows = {}; // Rows are copied in; free them before the customers are indexed
+            } else {
+                size_t n = total(pRows);
+                products.reserve(n, pFile.view().size()); productIndex.reserve(n);
+                for (const auto& rows : pRows) for (const ProductRow& r : rows) addProductRow(r);
+                pRows = {};
             }
-        }
+        });
 
-        // 3. Load Products
-        ifstream pFile("products.txt");
-        if(pFile.is_open()) {
-            while (getline(pFile, line)) {
-                stringstream ss(line); string segment; vector<string> data;
-                while(getline(ss, segment, '|')) data.push_back(segment);
-                if(data.size() >= 8) {
-                    int id = stoi(data[0]);
-                    products.push_back(Product(id, data[1], stod(data[2]), data[3], stoi(data[4]), stoi(data[5]), stod(data[6]), stoi(data[7])));
-                    if (id >= productCounter) productCounter = id + 1;
-                }
+        // 3. Index Customers
+        splitLegacyFile("customers.txt", "customers");
+        splitLegacyFile("carts.txt", "carts");
+        vector<int> shards;
+        for (const auto& entry : filesystem::directory_iterator(".")) {
+            string name = entry.path().filename().string();
+            int k;
+            if (name.size() > 14 && name.compare(0, 10, "customers.") == 0 && name.compare(name.size() - 4, 4, ".txt") == 0
+                && T::toInt(string_view(name).substr(10, name.size() - 14), k) && k >= 0) shards.push_back(k);
+        }
+        vector<vector<pair<size_t, int>>> found(shards.size()); // (email hash, id) per shard
+        parallelFor(shards.size(), [&](int t) {
+            MappedFile file(shardFile("customers", shards[t]));
+            vector<string_view> f;
+            T::forEachLine(file.view(), [&](string_view line) {
+                T::split(line, f);
+                CustomerRow r;
+                if (CustomerFormat::readText(f, 0, r) && shardOf(r.id) == shards[t]) found[t].emplace_back(hash<string_view>()(r.email), r.id);
+            });
+        });
+        customerEmailIds.reserve(total(found));
+        for (size_t t = 0; t < shards.size(); t++) {
+            if (shards[t] >= (int)customerShards.size()) customerShards.resize(shards[t] + 1);
+            vector<bool>& saved = customerShards[shards[t]].savedIds;
+            saved.assign(CUSTOMER_SHARD_SIZE, false);
+            for (const auto& e : found[t]) {
+                saved[e.second % CUSTOMER_SHARD_SIZE] = true;
+                customerEmailIds.emplace(e.first, e.second);
+                if (e.second >= customerCounter) customerCounter = e.second + 1;
             }
         }
+    }
 
-        // 4. Load Carts
-        // Reconstructs the customer stacks
-        ifstream cartFile("carts.txt");
-        if (cartFile.is_open()) {
-            while (getline(cartFile, line)) {
-                stringstream ss(line); string segment; vector<string> data;
-                while(getline(ss, segment, '|')) data.push_back(segment);
-
-                if(data.size() >= 3) {
-                    int cid = stoi(data[0]);
-                    int pid = stoi(data[1]);
-                    int qty = stoi(data[2]);
-
-                    // Locate Customer
-                    Customer* targetCust = nullptr;
-                    for (auto &c : customers) {
-                        if (c.id == cid) {
-                            targetCust = &c;
-                            break;
-                        }
-                    }
-
-                    // Locate Product
-                    Product targetProd;
-                    bool prodFound = false;
-                    for (auto &p : products) {
-                        if (p.id == pid) {
-                            targetProd = p;
-                            prodFound = true;
-                            break;
-                        }
-                    }
-
-                    // Push to stack if both exist
-                    if (targetCust != nullptr && prodFound) {
-                        CartItem item;
-                        item.product = targetProd;
-                        item.buyQty = qty;
-                        targetCust->cartStack.push(item);
-                    }
-                }
+    // Moves a table file from before sharding (customers.txt / carts.txt) into its shard files, then removes it.
+    // Logic: Each line goes to the shard of its first field (the customer id). If the process dies halfway,
+    // the old file is still there and the next start splits it again, overwriting the same shard files.
+    void splitLegacyFile(const string& legacy, const char* table) {
+        {
+            MappedFile file(legacy);
+            if (!file.isOpen()) return;
+            unordered_map<int, string> shards; // Shard number -> its lines
+            vector<string_view> f;
+            T::forEachLine(file.view(), [&](string_view line) {
+                T::split(line, f);
+                int id;
+                if (!T::toInt(f[0], id) || id < 0) return; // Malformed: the loaders would skip it too
+                string& out = shards[shardOf(id)];
+                out += line;
+                out += '\n';
+            });
+            for (const auto& shard : shards) {
+                if (Journal::writeFileAtomically(shardFile(table, shard.first), shard.second)) continue;
+                cerr << "[WARNING] Could not split " << legacy << "; it stays in use.\n";
+                return;
             }
         }
+        remove(legacy.c_str());
     }
 
     // --- HELPER: Display ---
-    void printHeader(string title) {
-        cout << "\n========================================\n";
-        cout << "   " << title << "\n";
-        cout << "========================================\n";
+
+    // Date text like "Wed Oct 14 14:37:39 2026\n"
+    static string timeText(time_t t) {
+        char dt[32];
+#ifdef _WIN32
+        ctime_s(dt, sizeof(dt), &t);
+#else
+        ctime_r(&t, dt); // ctime() shares one buffer between threads
+#endif
+        return dt;
+    }
+
+    void printHeader(Session& s, string title) {
+        s.out << "\n========================================\n";
+        s.out << "   " << title << "\n";
+        s.out << "========================================\n";
     }
 
     // ==========================================
     // 3. SELLER MODULE
     // ==========================================
 
-    void registerSeller() {
-        clearScreen();
+    void registerSeller(Session& s) {
+        clearScreen(s);
         string name, email;
-        printHeader("Seller Registration");
-        cout << "Enter Name: "; cin.ignore(); getline(cin, name);
-        cout << "Enter Email: "; cin >> email;
+        printHeader(s, "Seller Registration");
+        s.out << "Enter Name: "; s.in.ignore(); getline(s.in, name);
+        s.out << "Enter Email: "; s.in >> email;
 
-        sellers.push_back(Seller(sellerCounter++, name, email));
-        cout << "\n[SUCCESS] Welcome, " << name << "! You have been registered.\n";
-        saveData();
-        pause();
+        createSeller(name, email);
+        s.out << "\n[SUCCESS] Welcome, " << name << "! You have been registered.\n";
+        pause(s);
     }
 
-    bool loginSeller() {
-        clearScreen();
+    bool loginSeller(Session& s) {
+        clearScreen(s);
         string email;
-        printHeader("Seller Login");
-        cout << "Enter Email: "; cin >> email;
-        // Search Logic: Linear Search through Vector
-        for (int i = 0; i < sellers.size(); i++) {
-            if (sellers[i].email == email) {
-                currentSellerIdx = i;
-                cout << "\n[SUCCESS] Welcome back, " << sellers[i].name << "!\n";
-                pause();
-                return true;
-            }
-        }
-        cout << "\n[ERROR] Email not found.\n";
-        pause();
+        printHeader(s, "Seller Login");
+        s.out << "Enter Email: "; s.in >> email;
+        // Search Logic: Hash Index on email (O(1))
+        {
+            shared_lock<CatalogMutex> catalog(catalogLock);
+            int idx = findSellerByEmail(email);
+            if (idx != -1) {
+                s.sellerIdx = idx;
+                s.out << "\n[SUCCESS] Welcome back, " << sellers[idx].name << "!\n";
+            }
+        }
+        if (s.sellerIdx != -1) {
+            pause(s);
+            return true;
+        }
+        s.out << "\n[ERROR] Email not found.\n";
+        pause(s);
         return false;
     }
 
-    void sellerMenu() {
+    // FEATURE: BULK PRODUCT IMPORT
+    // One product per line: name|category|price|quantity (or comma-separated, decided by the first line).
+    // A first line whose price is not a number is taken as a column header and skipped.
+    // Logic: The mapped file is cut into line-aligned chunks that are parsed on separate threads with no lock held;
+    // then the catalog is locked once, the rows get a block of consecutive IDs and go into every index,
+    // and the products table is saved once (one snapshot write instead of a journal record per product).
+    // Invalid lines are skipped and reported to 'msg'. Returns true if the file was read and no line was skipped.
+    bool importProducts(int sellerIdx, const string& path, ostream& msg) {
+        MappedFile file(path);
+        if (!file.isOpen()) {
+            msg << "[ERROR] Cannot open " << path << ".\n";
+            return false;
+        }
+        string_view text = file.view();
+        char sep = text.substr(0, text.find('\n')).find('|') != string_view::npos ? '|' : ',';
+
+        struct Row {
+            string_view name, category;
+            double price;
+            int qty;
+        };
+        struct Chunk {
+            vector<Row> rows;
+            int lines = 0;         // Lines in the chunk, for numbering the next one
+            vector<int> badLines;  // Line numbers within the chunk (from 1)
+            size_t nameBytes = 0;
+        };
+
+        // 1. Parse the chunks in parallel (views into the mapped file, nothing shared)
+        vector<string_view> pieces = T::splitChunks(text, T::parseThreads(text.size()));
+        vector<Chunk> chunks(pieces.size());
+        auto parse = [&](int k) {
+            Chunk& out = chunks[k];
+            vector<string_view> f;
+            T::forEachLine(pieces[k], [&](string_view line) {
+                out.lines++;
+                T::split(line, f, sep);
+                Row r;
+                bool valid = f.size() == 4 && T::toDouble(T::trim(f[2]), r.price) && T::toInt(T::trim(f[3]), r.qty);
+                if (valid) {
+                    r.name = T::trim(f[0]);
+                    r.category = T::trim(f[1]);
+                    valid = !r.name.empty() && !r.category.empty() && r.price >= 0 && r.qty >= 0
+                            && r.name.find('|') == string_view::npos && r.category.find('|') == string_view::npos;
+                }
+                if (valid) {
+                    out.rows.push_back(r);
+                    out.nameBytes += r.name.size();
+                } else if (!(k == 0 && out.lines == 1)) { // Header line
+                    out.badLines.push_back(out.lines);
+                }
+            });
+        };
+        parallelFor(chunks.size(), parse);
+
+        // 2. Insert every row under one exclusive lock
+        size_t total = 0, nameBytes = 0;
+        for (const Chunk& c : chunks) { total += c.rows.size(); nameBytes += c.nameBytes; }
+        int firstId = 0;
+        bool saved = true;
+        if (total > 0) {
+            unique_lock<CatalogMutex> catalog(catalogLock);
+            products.reserveMore(total, nameBytes);
+            productIndex.reserve(products.size() + total);
+            firstId = productCounter;
+            int sellerId = sellers[sellerIdx].id;
+            for (const Chunk& c : chunks)
+                for (const Row& r : c.rows)
+                    addProduct(Product(productCounter, r.name, r.price, categories.intern(r.category), r.qty, sellerId));
+            // 3. Persist once: the products table goes out as a fresh snapshot (see compactData)
+            dirtyTables |= PRODUCTS;
+            long long ticket = compactData();
+            catalog.unlock();
+            journal.sync(); // On disk before we report success
+            saved = journal.written(ticket);
+        }
+
+        // Line numbers: already a line count before each chunk
+        int skipped = 0, before = 0;
+        vector<int> shown;
+        for (const Chunk& c : chunks) {
+            for (int line : c.badLines) {
+                if (shown.size() < 10) shown.push_back(before + line);
+                skipped++;
+            }
+            before += c.lines;
+        }
+        if (!saved) {
+            // Note: The rows are not journaled: they stay only in memory until a later save succeeds.
+            msg << "[ERROR] Imported " << total << " products (IDs " << firstId << "-" << firstId + (int)total - 1
+                << ") but could not save them to disk.\n";
+        }
+        else if (total > 0) msg << "[SUCCESS] Imported " << total << " products (IDs " << firstId << "-" << firstId + (int)total - 1 << ").\n";
+        else msg << "[INFO] No products to import.\n";
+        if (skipped > 0) {
+            msg << "[ERROR] Skipped " << skipped << " invalid line(s):";
+            for (int line : shown) msg << " " << line;
+            if (skipped > (int)shown.size()) msg << " ...";
+            msg << "\n";
+        }
+        return saved && skipped == 0;
+    }
+
+    void sellerMenu(Session& s) {
         int choice;
         do {
-            clearScreen();
-            printHeader("SELLER DASHBOARD");
-            cout << "Logged in as: " << sellers[currentSellerIdx].name << endl;
-            cout << "----------------------------------------\n";
-            cout << "1. Add New Product\n";
-            cout << "2. Logout\n";
-            cout << "----------------------------------------\n";
-            cout << "Enter Choice: ";
-            choice = getIntInput();
+            maybeCompact();
+            clearScreen(s);
+            printHeader(s, "SELLER DASHBOARD");
+            {
+                shared_lock<CatalogMutex> catalog(catalogLock);
+                s.out << "Logged in as: " << sellers[s.sellerIdx].name << endl;
+            }
+            s.out << "----------------------------------------\n";
+            s.out << "1. Add New Product\n";
+            s.out << "2. Import Products from File\n";
+            s.out << "3. Inventory & Rating Analytics\n";
+            s.out << "4. Logout\n";
+            s.out << "----------------------------------------\n";
+            s.out << "Enter Choice: ";
+            choice = getIntInput(s);
 
             if (choice == 1) {
-                string name, cat; double price; int qty;
-                cout << "\nEnter Product Name: "; cin.ignore(); getline(cin, name);
-                cout << "Enter Category: "; getline(cin, cat);
-                cout << "Enter Price: $"; cin >> price;
-                cout << "Enter Quantity: "; cin >> qty;
+                string name, cat; double price = 0; int qty = 0;
+                s.out << "\nEnter Product Name: "; s.in.ignore(); getline(s.in, name);
+                s.out << "Enter Category: "; getline(s.in, cat);
+                s.out << "Enter Price: $"; s.in >> price;
+                s.out << "Enter Quantity: "; s.in >> qty;
 
-                products.push_back(Product(productCounter++, name, price, cat, qty, sellers[currentSellerIdx].id));
-                cout << "\n[SUCCESS] Product '" << name << "' added successfully!\n";
-                saveData();
-                pause();
+                createProduct(s.sellerIdx, name, cat, price, qty);
+                s.out << "\n[SUCCESS] Product '" << name << "' added successfully!\n";
+                pause(s);
+            }
+            else if (choice == 2 && !s.console) {
+                // The path would be opened with the server's permissions: only the local console may import
+                s.out << "\n[ERROR] Importing from a file is only available on the server's own console.\n";
+                pause(s);
+            }
+            else if (choice == 2) {
+                string path;
+                s.out << "\nEnter File Path (name|category|price|quantity per line): "; s.in.ignore(); getline(s.in, path);
+                s.out << "\n";
+                importProducts(s.sellerIdx, path, s.out);
+                pause(s);
+            }
+            else if (choice == 3) {
+                showSellerAnalytics(s);
             }
-        } while (choice != 2);
-        currentSellerIdx = -1;
+        } while (choice != 4);
+        s.sellerIdx = -1;
+    }
+
+    // Inventory value, ratings and stock warnings over all of a seller's products
+    ProductStore::Totals sellerTotals(int sellerIdx) {
+        METRIC_TIMER(SELLER_ANALYTICS);
+        shared_lock<CatalogMutex> catalog(catalogLock);
+        auto it = sellerProducts.find(sellers[sellerIdx].id);
+        if (it == sellerProducts.end()) return ProductStore::Totals();
+        lock_guard<RatingMutex> ratings(ratingLock); // The rating columns
+        return products.aggregate(it->second, LOW_STOCK);
+    }
+
+    void showSellerAnalytics(Session& s) {
+        clearScreen(s);
+        printHeader(s, "INVENTORY & RATING ANALYTICS");
+        ProductStore::Totals t = sellerTotals(s.sellerIdx);
+        if (t.products == 0) {
+            s.out << "\n[INFO] You have no products yet.\n";
+            pause(s);
+            return;
+        }
+        ios::fmtflags flags = s.out.flags(); // Fixed-point money must not leak into later screens
+        streamsize prec = s.out.precision();
+        s.out << left << setw(24) << "Products:" << t.products << "\n";
+        s.out << left << setw(24) << "Units in Stock:" << t.units << "\n";
+        s.out << left << setw(24) << "Inventory Value:" << "$" << fixed << setprecision(2) << t.inventoryValue << "\n";
+        s.out << left << setw(24) << "Average Rating:" << setprecision(2) << t.averageRating() << " / 5 (from "
+              << t.ratingCount << " ratings)\n";
+        s.out.flags(flags);
+        s.out.precision(prec);
+        s.out << left << setw(24) << "Low on Stock:" << t.lowStock << " (fewer than " << LOW_STOCK << " units)\n";
+        s.out << left << setw(24) << "Unrated:" << t.unrated << "\n";
+        pause(s);
     }
 
     // ==========================================
     // 4. CUSTOMER MODULE
     // ==========================================
 
-    void registerCustomer() {
-        clearScreen();
+    void registerCustomer(Session& s) {
+        clearScreen(s);
         string name, email, addr, phone;
-        printHeader("Customer Registration");
-        cout << "Enter Name: "; cin.ignore(); getline(cin, name);
-        cout << "Enter Email: "; cin >> email;
-        cout << "Enter Address: "; cin.ignore(); getline(cin, addr);
-        cout << "Enter Phone: "; cin >> phone;
+        printHeader(s, "Customer Registration");
+        s.out << "Enter Name: "; s.in.ignore(); getline(s.in, name);
+        s.out << "Enter Email: "; s.in >> email;
+        s.out << "Enter Address: "; s.in.ignore(); getline(s.in, addr);
+        s.out << "Enter Phone: "; s.in >> phone;
+
+        createCustomer(name, addr, phone, email);
+        s.out << "\n[SUCCESS] Welcome, " << name << "! Registration complete.\n";
+        pause(s);
+    }
+
+    void logoutCustomer(Session& s) {
+        unique_lock<CatalogMutex> catalog(catalogLock);
+        pinCustomer(s.customerIdx, -1);
+        s.customerIdx = -1;
+    }
 
-        customers.push_back(Customer(customerCounter++, name, addr, phone, email));
-        cout << "\n[SUCCESS] Welcome, " << name << "! Registration complete.\n";
-        saveData();
-        pause();
+    // Logs the session in as the customer with this email; false if there is none. Undone by logoutCustomer.
+    // Search Logic: Hash Index on email (O(1)), then the customer's shard is loaded if needed
+    bool loginByEmail(Session& s, const string& email) {
+        unique_lock<CatalogMutex> catalog(catalogLock); // Loading may move rows in and out of customers
+        int idx = loadCustomerByEmail(email);
+        if (idx == -1) return false;
+        pinCustomer(idx, 1);
+        s.customerIdx = idx;
+        return true;
     }
 
-    bool loginCustomer() {
-        clearScreen();
+    bool loginCustomer(Session& s) {
+        clearScreen(s);
         string email;
-        printHeader("Customer Login");
-        cout << "Enter Email: "; cin >> email;
-        // Search Logic: Linear Search
-        for (int i = 0; i < customers.size(); i++) {
-            if (customers[i].email == email) {
-                currentCustomerIdx = i;
-                cout << "\n[SUCCESS] Welcome back, " << customers[i].name << "!\n";
-                pause();
-                return true;
-            }
-        }
-        cout << "\n[ERROR] Email not found.\n";
-        pause();
+        printHeader(s, "Customer Login");
+        s.out << "Enter Email: "; s.in >> email;
+        if (loginByEmail(s, email)) {
+            {
+                shared_lock<CatalogMutex> catalog(catalogLock);
+                s.out << "\n[SUCCESS] Welcome back, " << customers[s.customerIdx].name << "!\n";
+            }
+            pause(s);
+            return true;
+        }
+        s.out << "\n[ERROR] Email not found.\n";
+        pause(s);
         return false;
     }
 
     // Utility: Table Formatting
-    void displayProductTable(const vector<Product>& pList) {
-        cout << "\n";
-        cout << left << setw(5) << "ID" << setw(20) << "Name" << setw(15) << "Category" << setw(10) << "Price" << setw(10) << "Stock" << setw(10) << "Rating" << endl;
-        cout << "--------------------------------------------------------------------------------\n";
-        for (const auto& p : pList) {
-            cout << left << setw(5) << p.id << setw(20) << p.name << setw(15) << p.category
-                 << "$" << setw(9) << p.price << setw(10) << p.quantity << setw(10) << setprecision(2) << p.getAverageRating() << endl;
+    // Takes positions in the products vector, so callers never copy Products just to print them
+    // Note: Caller holds catalogLock (shared); each row's rating is read under its stripe.
+    void displayProductTable(Session& s, const vector<int>& idxList) {
+        s.out << "\n";
+        s.out << left << setw(5) << "ID" << setw(20) << "Name" << setw(15) << "Category" << setw(10) << "Price" << setw(10) << "Stock" << setw(10) << "Rating" << endl;
+        s.out << "--------------------------------------------------------------------------------\n";
+        for (int idx : idxList) {
+            int stock = max(0, products.available(idx)); // What can still be added to a cart
+            double rating;
+            {
+                lock_guard<StripeMutex> row(productLock(idx));
+                rating = products.averageRating(idx);
+            }
+            streamsize prec = s.out.precision(); // Rating precision must not leak into the next row's price
+            s.out << left << setw(5) << products.id[idx] << setw(20) << products.name(idx) << setw(15) << categories.name(products.categoryId[idx])
+                  << "$" << setw(9) << products.price[idx] << setw(10) << stock
+                  << setw(10) << setprecision(2) << rating << setprecision(prec) << endl;
+        }
+        s.out << "--------------------------------------------------------------------------------\n";
+    }
+
+    // --- PAGINATED LISTINGS ---
+
+    // Logic: Higher Average Rating first; ties keep catalog order (same order as RatingIndex)
+    bool ranksBefore(int a, int b) const {
+        double ra = products.averageRating(a), rb = products.averageRating(b); // Touches rating columns only
+        if (ra != rb) return ra > rb;
+        return a < b;
+    }
+
+    // Top-K over a result set: orders only rows [offset, offset + k) of 'matches' by 'cmp'.
+    // Logic: nth_element splits off everything ranked above the page, partial_sort orders the page itself.
+    // Cost is O(n + k log k) per screen instead of sorting every match.
+    template <typename Cmp>
+    static vector<int> sortedPage(vector<int>& matches, int offset, int k, Cmp cmp) {
+        int n = matches.size();
+        if (offset >= n) return vector<int>();
+        int end = min(n, offset + k);
+        if (offset > 0) nth_element(matches.begin(), matches.begin() + offset, matches.end(), cmp);
+        partial_sort(matches.begin() + offset, matches.begin() + end, matches.end(), cmp);
+        return vector<int>(matches.begin() + offset, matches.begin() + end);
+    }
+
+    // Note: Holds ratingLock, so no rating changes while the comparison runs.
+    vector<int> rankedPage(vector<int>& matches, int offset, int k) {
+        lock_guard<RatingMutex> ratings(ratingLock);
+        return sortedPage(matches, offset, k, [this](int a, int b) { return ranksBefore(a, b); });
+    }
+
+    // A page of results in the given order
+    // Note: Caller holds catalogLock (prices only change under it exclusively).
+    vector<int> queryPage(ProductQuery::Sort order, vector<int>& matches, int offset, int k) {
+        if (order == ProductQuery::BY_RATING) return rankedPage(matches, offset, k);
+        bool ascending = order == ProductQuery::PRICE_LOW_HIGH;
+        return sortedPage(matches, offset, k, [&](int a, int b) { return pricedBefore(a, b, ascending); });
+    }
+
+    // Logic: Price order; ties keep catalog order
+    bool pricedBefore(int a, int b, bool ascending) const {
+        double pa = products.price[a], pb = products.price[b];
+        if (pa != pb) return ascending ? pa < pb : pa > pb;
+        return a < b;
+    }
+
+    // Screens of a listing ranked when it is computed; later screens are ranked on demand (see showListing)
+    static constexpr int RANKED_PAGES = 5;
+
+    // Top-K in place: puts the first k rows in order (the rest stay unordered) and returns how many that is.
+    // Cost is O(n log k) instead of sorting every match.
+    // Note: Caller holds catalogLock.
+    size_t rankRows(vector<int>& rows, ProductQuery::Sort order, size_t k) {
+        k = min(k, rows.size());
+        if (order == ProductQuery::BY_RATING) {
+            lock_guard<RatingMutex> ratings(ratingLock);
+            partial_sort(rows.begin(), rows.begin() + k, rows.end(), [this](int a, int b) { return ranksBefore(a, b); });
+            return k;
+        }
+        bool ascending = order == ProductQuery::PRICE_LOW_HIGH;
+        partial_sort(rows.begin(), rows.begin() + k, rows.end(), [&](int a, int b) { return pricedBefore(a, b, ascending); });
+        return k;
+    }
+
+    // --- RESULT CACHE ---
+    // Read-through: the cached listing for 'key' if still current, else match()'s rows with the first
+    // RANKED_PAGES screens put in 'order' (which is then cached).
+    // 'depends' says which ResultCache::Depends generations the listing must match.
+    ResultCache::Rows cachedResult(const string& key, int depends, ProductQuery::Sort order, const function<vector<int>()>& match) {
+        ProductStore::Generations now = products.generations(); // Read first: a change during match() leaves the entry stale
+        if (ResultCache::Rows hit = resultCache.find(key, now)) {
+            METRIC_ADD(Metrics::CACHE_HITS, 1);
+            return hit;
+        }
+        METRIC_ADD(Metrics::CACHE_MISSES, 1);
+        ResultCache::Listing listing{match(), 0, order};
+        {
+            shared_lock<CatalogMutex> catalog(catalogLock);
+            listing.ranked = rankRows(listing.rows, order, RANKED_PAGES * PAGE_SIZE);
+        }
+        ResultCache::Rows rows = make_shared<const ResultCache::Listing>(move(listing));
+        resultCache.put(key, now, depends, rows);
+        return rows;
+    }
+
+    // A category's products, best rated first
+    ResultCache::Rows categoryListing(const string& cat) {
+        return cachedResult("category|" + cat, ResultCache::ON_RATINGS, ProductQuery::BY_RATING,
+                            [&] { return productsInCategory(cat); });
+    }
+
+    // Name search results, best rated first (the search ignores case, so the key does too)
+    ResultCache::Rows nameListing(const string& searchName) {
+        string search(T::trim(searchName));
+        for (char& ch : search) ch = tolower((unsigned char)ch);
+        return cachedResult("name|" + search, ResultCache::ON_RATINGS, ProductQuery::BY_RATING,
+                            [&] { return searchProducts(search); });
+    }
+
+    // Advanced search results in the query's order
+    ResultCache::Rows queryListing(const ProductQuery& q) {
+        string key = "query|" + q.category + "|";
+        T::writeDouble(key, q.minPrice); key += '|';
+        T::writeDouble(key, q.maxPrice); key += '|';
+        T::writeDouble(key, q.minRating); key += '|';
+        key += q.inStockOnly ? 'y' : 'n';
+        key += char('0' + q.sort);
+        int depends = q.inStockOnly ? ResultCache::ON_STOCK : 0;
+        if (q.minRating > 0 || q.sort == ProductQuery::BY_RATING) depends |= ResultCache::ON_RATINGS;
+        return cachedResult(key, depends, q.sort, [&] { return queryProducts(q); });
+    }
+
+    // Shows a listing one screen at a time (each screen costs O(page) to print)
+    // fetch(page, rows) fills the rows of page number 'page' and returns true if more pages follow.
+    // Logic: The catalog is locked while one screen is built, never while waiting for the user.
+    void showPages(Session& s, const string& title, const function<bool(int, vector<int>&)>& fetch) {
+        int page = 0;
+        vector<int> rows;
+        while (true) {
+            clearScreen(s);
+            bool more;
+            {
+                shared_lock<CatalogMutex> catalog(catalogLock);
+                more = fetch(page, rows);
+                s.out << "\n--- " << title;
+                if (page > 0 || more) s.out << " (Page " << page + 1 << ")";
+                s.out << " ---\n";
+                displayProductTable(s, rows);
+            }
+
+            // A listing that fits on one screen behaves like before: just wait for Enter
+            if (page == 0 && !more) {
+                pause(s);
+                return;
+            }
+            if (more) s.out << "1. Next Page\n";
+            if (page > 0) s.out << "2. Previous Page\n";
+            s.out << "0. Back\nChoice: ";
+            int choice = getIntInput(s);
+            if (choice == 1 && more) page++;
+            else if (choice == 2 && page > 0) page--;
+            else if (choice == 0) return;
         }
-        cout << "--------------------------------------------------------------------------------\n";
+    }
+
+    // Paginates a listing: a screen among the ranked ones is a slice of it, a later one is ranked on its own
+    // Note: 'ranked' is all rows or a whole number of screens, so no screen straddles the two.
+    void showListing(Session& s, const string& title, const ResultCache::Rows& listing) {
+        showPages(s, title, [&](int page, vector<int>& rows) {
+            const vector<int>& all = listing->rows;
+            size_t from = min(all.size(), size_t(page) * PAGE_SIZE);
+            size_t to = min(all.size(), from + PAGE_SIZE);
+            if (to <= listing->ranked) rows.assign(all.begin() + from, all.begin() + to);
+            else {
+                vector<int> rest(all.begin() + listing->ranked, all.end()); // The cached listing is shared: rank a copy
+                rows = queryPage(listing->order, rest, from - listing->ranked, PAGE_SIZE);
+            }
+            return to < all.size();
+        });
     }
 
     // FEATURE: TOP RATED PRODUCTS
-    // DATA STRUCTURE: PRIORITY QUEUE (Max Heap)
-    // Reason: Automatically orders products by rating (Operator < Overload) without manually sorting.
-    void showTopRatedProducts() {
-        clearScreen();
-        priority_queue<Product> pq;
-        for (const auto& p : products) pq.push(p);
+    // DATA STRUCTURE: ORDERED SET (see RatingIndex)
+    // Reason: Products are already kept in rating order, so listing them is a walk from the top, not a sort.
+    // Pages are read straight off the ranking through key cursors: O(log n + page) per screen.
+    void showTopRatedProducts(Session& s) {
+        vector<RatingIndex::Entry> pageStarts{RatingIndex::start()}; // Cursor for each page seen so far
+        showPages(s, "Recommended Products (By Rating)", [&](int page, vector<int>& rows) {
+            RatingIndex::Entry next = pageStarts[page];
+            bool more = topRatedPage(next, rows);
+            if ((int)pageStarts.size() == page + 1) pageStarts.push_back(next);
+            else pageStarts[page + 1] = next;
+            return more;
+        });
+    }
+
+    // One screen of the rating ranking: fills 'rows' with the products ranked after 'cursor',
+    // moves 'cursor' past them, and returns true if more follow.
+    bool topRatedPage(RatingIndex::Entry& cursor, vector<int>& rows) {
+        METRIC_TIMER(TOP_RATED);
+        lock_guard<RatingMutex> ratings(ratingLock);
+        cursor = ratingIndex.page(cursor, PAGE_SIZE, rows);
+        return ratingIndex.hasAfter(cursor);
+    }
+
+    // Positions of the products in a category (empty if the category is unknown)
+    // Logic: Direct posting-list lookup: no scan of the catalog
+    vector<int> productsInCategory(const string& cat) {
+        METRIC_TIMER(CATEGORY_FILTER);
+        shared_lock<CatalogMutex> catalog(catalogLock);
+        int catId = categories.find(cat);
+        if (catId == -1) return vector<int>();
+        return categories.productsIn(catId);
+    }
 
-        cout << "\n--- Recommended Products (By Rating) ---\n";
-        vector<Product> temp;
-        // Extract top elements from PQ
-        while (!pq.empty()) {
-            temp.push_back(pq.top());
-            pq.pop();
+    // FEATURE: ADVANCED SEARCH (multi-attribute query)
+    // Logic: Candidates start from the most selective source: the category's posting list, else the
+    // price range, else the rating prefix (each read into a bitmap, so the rows come out in catalog order).
+    // Every further condition narrows them through its own index: the index range is marked in a bitmap
+    // and each candidate is one bit test. Visiting a tree node costs about as much as checking
+    // INDEX_WALK_COST candidates against a column, so once the range outgrows that share of the candidates
+    // the walk stops and the candidates are checked on the column instead: no step costs much more than
+    // the rows it starts with. Stock changes constantly and is always checked on the column.
+    // Returns matching positions in catalog order; queryListing() ranks the first screens, showListing() the rest.
+    static constexpr int INDEX_WALK_COST = 8;
+
+    vector<int> queryProducts(const ProductQuery& q) {
+        METRIC_TIMER(QUERY);
+        shared_lock<CatalogMutex> catalog(catalogLock);
+        int n = products.size();
+        bool byPrice = q.minPrice > 0 || q.maxPrice < numeric_limits<double>::infinity();
+        bool byRating = q.minRating > 0;
+
+        vector<int> rows;
+        bool started = false;
+        // walk(f) feeds an index range to f (stopping when f returns false); test(idx) checks the column
+        auto narrow = [&](auto walk, auto test) {
+            RowBitmap bits(n);
+            if (!started) {
+                walk([&](int idx) { bits.set(idx); return true; });
+                bits.forEach([&](int idx) { rows.push_back(idx); });
+                started = true;
+                return;
+            }
+            size_t budget = rows.size() / INDEX_WALK_COST;
+            bool complete = walk([&](int idx) {
+                bits.set(idx);
+                return budget-- > 0;
+            });
+            if (complete) rows.erase(remove_if(rows.begin(), rows.end(), [&](int idx) { return !bits.test(idx); }), rows.end());
+            else rows.erase(remove_if(rows.begin(), rows.end(), [&](int idx) { return !test(idx); }), rows.end());
+        };
+
+        if (!q.category.empty()) {
+            int catId = categories.find(q.category);
+            if (catId == -1) return vector<int>();
+            rows = categories.productsIn(catId);
+            started = true;
         }
-        displayProductTable(temp);
-        pause();
+        if (byPrice)
+            narrow([&](auto f) { return priceIndex.forEachInRange(q.minPrice, q.maxPrice, f); },
+                   [&](int idx) { return products.price[idx] >= q.minPrice && products.price[idx] <= q.maxPrice; });
+        if (byRating) {
+            lock_guard<RatingMutex> ratings(ratingLock);
+            narrow([&](auto f) { return ratingIndex.forEachAtLeast(q.minRating, f); },
+                   [&](int idx) { return products.averageRating(idx) >= q.minRating; });
+        }
+        if (!started) {
+            rows.resize(n);
+            for (int idx = 0; idx < n; idx++) rows[idx] = idx;
+        }
+        if (q.inStockOnly)
+            rows.erase(remove_if(rows.begin(), rows.end(), [&](int idx) { return products.available(idx) <= 0; }), rows.end());
+        return rows;
+    }
+
+    // Positions of the products whose name contains 'searchName', ignoring case.
+    // A trailing '*' means "starts with" instead.
+    vector<int> searchProducts(const string& searchName) {
+        METRIC_TIMER(SEARCH);
+        bool prefix = !searchName.empty() && searchName.back() == '*';
+        string query = prefix ? searchName.substr(0, searchName.size() - 1) : searchName;
+        shared_lock<CatalogMutex> catalog(catalogLock);
+        return nameIndex.search(query, prefix, products.size(), [this](int idx) { return products.name(idx); });
     }
 
     // FEATURE: VIEW CART
-    // Logic: Stack is LIFO, so we pop to a temp stack to display items, then (optionally) restore.
-    void viewCart() {
-        clearScreen();
-        Customer* c = &customers[currentCustomerIdx];
-        if (c->cartStack.empty()) {
-            cout << "\n[INFO] Your Cart is Empty.\n";
-            pause();
-            return;
+    // Logic: Stack is LIFO, so items are listed newest first, read in place without copying the cart.
+    void viewCart(Session& s) {
+        clearScreen(s);
+        bool empty;
+        {
+            shared_lock<CatalogMutex> catalog(catalogLock);
+            lock_guard<StripeMutex> cartGuard(customerLock(s.customerIdx));
+            const Customer& c = customers[s.customerIdx];
+            empty = c.cart.empty();
+            if (!empty) {
+                s.out << "\n--- Your Shopping Cart ---\n";
+                double currentTotal = 0;
+
+                c.cart.forEachNewestFirst([&](const CartItem& item) {
+                    int pIdx = findProduct(item.productId);
+                    if (pIdx == -1) return;
+                    double itemTotal = products.price[pIdx] * item.buyQty; // Live price and name
+                    currentTotal += itemTotal;
+                    s.out << "* " << products.name(pIdx) << " (Qty: " << item.buyQty << ") - $" << itemTotal << endl;
+                });
+                s.out << "--------------------------\n";
+                s.out << "Total Estimate: $" << currentTotal << endl;
+            }
+        }
+        if (empty) s.out << "\n[INFO] Your Cart is Empty.\n";
+        pause(s);
+    }
+
+    // FEATURE: REMOVE FROM CART
+    // Takes a product's line out of the cart, or with productId 0 undoes the last add; the units go back
+    // on the shelf. Returns false if there was no such line.
+    bool removeFromCart(int customerIdx, int productId) {
+        shared_lock<CatalogMutex> catalog(catalogLock);
+        lock_guard<StripeMutex> cartGuard(customerLock(customerIdx));
+        Customer& c = customers[customerIdx];
+        CartItem item{productId, c.cart.quantityOf(productId)};
+        bool removed;
+        if (productId == 0) {
+            removed = c.cart.undoLast(item); // Pop the top of the stack
+        } else {
+            removed = c.cart.remove(productId);
+        }
+        if (!removed) return false; // Nothing changed: nothing to journal
+        products.release(findProduct(item.productId), item.buyQty); // Back on the shelf
+        journalCart(c);
+        return true;
+    }
+
+    // FEATURE: ADD TO CART
+    // Returns true if the item went into the customer's cart; writes the outcome to 'msg' as one line either way.
+    bool addToCart(int customerIdx, int pid, int qty, ostream& msg) {
+        shared_lock<CatalogMutex> catalog(catalogLock);
+        int pIdx = findProduct(pid);
+        if (pIdx == -1) {
+            msg << "[ERROR] Product ID not found.\n";
+            return false;
+        }
+        if (qty <= 0) {
+            msg << "[ERROR] Quantity must be at least 1.\n";
+            return false;
         }
+        lock_guard<StripeMutex> cartGuard(customerLock(customerIdx));
+        Customer& c = customers[customerIdx];
+        int inCart = c.cart.quantityOf(pid); // Repeat adds merge into one line
+        // Reserve first: the units are held for this cart until removed or checked out
+        if (!products.reserve(pIdx, qty)) {
+            msg << "[ERROR] Insufficient Stock! Only " << max(0, products.available(pIdx)) << " available";
+            if (inCart > 0) msg << " (" << inCart << " already in your cart)";
+            msg << ".\n";
+            return false;
+        }
+        c.cart.add(pid, qty); // Push to Stack
+        msg << "[SUCCESS] Added " << qty << " x " << products.name(pIdx) << " to cart.\n";
+        journalCart(c); // Auto-save
+        return true;
+    }
 
-        cout << "\n--- Your Shopping Cart ---\n";
-        stack<CartItem> tempStack = c->cartStack; // Copy stack
-        double currentTotal = 0;
+    // Asks for each condition of a ProductQuery (Enter skips it), then pages through the matches
+    void advancedSearch(Session& s) {
+        clearScreen(s);
+        printHeader(s, "Advanced Search");
+        ProductQuery q;
+        string line;
+        bool valid = true;
+        // Blank keeps the default; anything else must be a number
+        auto askNumber = [&](const string& prompt, double& value) {
+            s.out << prompt; getline(s.in, line);
+            string_view text = T::trim(line);
+            if (!text.empty() && !T::toDouble(text, value)) valid = false;
+        };
+        s.out << "Category (Enter = any): "; s.in.ignore(); getline(s.in, line);
+        q.category = string(T::trim(line));
+        askNumber("Min Price (Enter = 0): $", q.minPrice);
+        askNumber("Max Price (Enter = no limit): $", q.maxPrice);
+        askNumber("Min Rating 0-5 (Enter = any): ", q.minRating);
+        s.out << "In stock only? (y/n): "; getline(s.in, line);
+        q.inStockOnly = !line.empty() && (line[0] == 'y' || line[0] == 'Y');
+        s.out << "Sort by: 1. Rating  2. Price (Low to High)  3. Price (High to Low): "; getline(s.in, line);
+        if (T::trim(line) == "2") q.sort = ProductQuery::PRICE_LOW_HIGH;
+        else if (T::trim(line) == "3") q.sort = ProductQuery::PRICE_HIGH_LOW;
 
-        while(!tempStack.empty()) {
-            CartItem item = tempStack.top();
-            tempStack.pop();
-            double itemTotal = item.product.price * item.buyQty;
-            currentTotal += itemTotal;
-            cout << "* " << item.product.name << " (Qty: " << item.buyQty << ") - $" << itemTotal << endl;
+        if (!valid || q.minPrice > q.maxPrice) {
+            s.out << "\n[ERROR] Invalid price or rating.\n";
+            pause(s);
+            return;
+        }
+        ResultCache::Rows matches = queryListing(q);
+        if (matches->rows.empty()) {
+            s.out << "\n[INFO] No products match these conditions.\n";
+            pause(s);
+            return;
         }
-        cout << "--------------------------\n";
-        cout << "Total Estimate: $" << currentTotal << endl;
-        pause();
+        showListing(s, "Search Results (" + to_string(matches->rows.size()) + " found)", matches);
     }
 
     // CUSTOMER DASHBOARD
-    void customerMenu() {
+    void customerMenu(Session& s) {
         int choice;
-        Customer* c = &customers[currentCustomerIdx];
 
         do {
-            clearScreen();
-            printHeader("CUSTOMER DASHBOARD");
-            cout << "Logged in as: " << c->name << endl;
-            cout << "----------------------------------------\n";
-            cout << "1. Browse All Products (By Rating)\n";
-            cout << "2. Filter by Category\n";
-            cout << "3. Search by Name\n"; 
-            cout << "4. Add Product to Cart\n";
-            cout << "5. View Cart\n";
-            cout << "6. Undo Last Item (Remove from Cart)\n";
-            cout << "7. Checkout\n";
-            cout << "8. Logout\n";
-            cout << "----------------------------------------\n";
-            cout << "Enter Choice: ";
-            choice = getIntInput();
-
-            if (choice == 1) showTopRatedProducts();
+            maybeCompact();
+            clearScreen(s);
+            printHeader(s, "CUSTOMER DASHBOARD");
+            {
+                shared_lock<CatalogMutex> catalog(catalogLock);
+                s.out << "Logged in as: " << customers[s.customerIdx].name << endl;
+            }
+            s.out << "----------------------------------------\n";
+            s.out << "1. Browse All Products (By Rating)\n";
+            s.out << "2. Filter by Category\n";
+            s.out << "3. Search by Name\n";
+            s.out << "4. Add Product to Cart\n";
+            s.out << "5. View Cart\n";
+            s.out << "6. Undo Last Item (Remove from Cart)\n";
+            s.out << "7. Checkout\n";
+            s.out << "8. Order History\n";
+            s.out << "9. Advanced Search (Price / Rating / Stock)\n";
+            s.out << "10. Logout\n";
+            s.out << "----------------------------------------\n";
+            s.out << "Enter Choice: ";
+            choice = getIntInput(s);
+
+            if (choice == 1) showTopRatedProducts(s);
             else if (choice == 2) {
                 // Filter Logic
-                clearScreen();
+                clearScreen(s);
                 string cat;
-                cout << "Enter Category Name: "; cin.ignore(); getline(cin, cat);
-                vector<Product> filtered;
-                for(auto &p : products) {
-                    if(p.category == cat) filtered.push_back(p);
+                s.out << "Enter Category Name: "; s.in.ignore(); getline(s.in, cat);
+                ResultCache::Rows filtered = categoryListing(cat);
+                if(filtered->rows.empty()) {
+                    s.out << "\n[INFO] No products found in this category.\n";
+                    pause(s);
                 }
-                if(filtered.empty()) cout << "\n[INFO] No products found in this category.\n";
-                else displayProductTable(filtered);
-                pause();
+                else showListing(s, "Category: " + cat, filtered);
             }
             else if (choice == 3) {
-                clearScreen();
+                clearScreen(s);
                 string searchName;
-                cout << "Enter Product Name (Partial or Full): "; cin.ignore(); getline(cin, searchName);
-                vector<Product> filtered;
-                for(auto &p : products) {
-                    // Check if searchName is inside the product name
-                    if(p.name.find(searchName) != string::npos) {
-                        filtered.push_back(p);
-                    }
+                s.out << "Enter Product Name (Partial or Full, end with * for 'starts with'): "; s.in.ignore(); getline(s.in, searchName);
+                // Check if searchName is inside (or at the start of) the product name, ignoring case
+                ResultCache::Rows filtered = nameListing(searchName);
+                if(filtered->rows.empty()) {
+                    s.out << "\n[INFO] No products found matching '" << searchName << "'.\n";
+                    pause(s);
                 }
-                if(filtered.empty()) cout << "\n[INFO] No products found matching '" << searchName << "'.\n";
-                else displayProductTable(filtered);
-                pause();
+                else showListing(s, "Search: " + searchName, filtered);
             }
             // ------------------------------------
             else if (choice == 4) {
                 // Add to Cart Logic
-                int pid, qty;
-                cout << "Enter Product ID: "; cin >> pid;
-                cout << "Enter Quantity: "; cin >> qty;
-
-                bool found = false;
-                for(auto &p : products) {
-                    if(p.id == pid) {
-                        found = true;
-                        if (qty > p.quantity) {
-                            cout << "\n[ERROR] Insufficient Stock! Only " << p.quantity << " available.\n";
-                        } else {
-                            CartItem item; item.product = p; item.buyQty = qty;
-                            c->cartStack.push(item); // Push to Stack
-                            cout << "\n[SUCCESS] Added " << qty << " x " << p.name << " to cart.\n";
-                            saveData(); // Auto-save
-                        }
-                        break;
-                    }
-                }
-                if(!found) cout << "\n[ERROR] Product ID not found.\n";
-                pause();
+                int pid = 0, qty = 0;
+                s.out << "Enter Product ID: "; s.in >> pid;
+                s.out << "Enter Quantity: "; s.in >> qty;
+                s.out << "\n";
+                addToCart(s.customerIdx, pid, qty, s.out);
+                pause(s);
             }
             else if (choice == 5) {
-                viewCart();
+                viewCart(s);
             }
             else if (choice == 6) {
+                bool empty;
+                {
+                    shared_lock<CatalogMutex> catalog(catalogLock);
+                    lock_guard<StripeMutex> cartGuard(customerLock(s.customerIdx));
+                    empty = customers[s.customerIdx].cart.empty();
+                }
+                if(!empty) {
+                    int productId = -1;
+                    s.out << "\nEnter Item Id to remove (0 = last added): ";
+                    s.in >>productId;
 
-                stack<CartItem> temp;
-                bool removed = false;                    
-                
-                if(!c->cartStack.empty()) {
-                    int productId;
-                    cout << "\nEnter Item Id to remove: ";
-                    cin >>productId;
-
-                    while (!c->cartStack.empty()) {
-                        if (c->cartStack.top().product.id == productId && !removed) {
-                            c->cartStack.pop();   // remove target
-                            removed = true;
-                            break;
-                        } else {
-                            temp.push(c->cartStack.top());
-                            c->cartStack.pop();
-                        }
-                    }
-                    // Restore items
-                    while (!temp.empty()) {
-                        c->cartStack.push(temp.top());
-                        temp.pop();
-                    }
+                    bool removed = removeFromCart(s.customerIdx, productId);
                     if (!removed)
-                        cout << "[INFO] Item not found in cart.\n";
-                    else 
-                        cout << "[INFO] Item Removed from the cart.\n";
-
-                    saveData();
+                        s.out << "[INFO] Item not found in cart.\n";
+                    else
+                        s.out << "[INFO] Item Removed from the cart.\n";
                 } else {
-                    cout << "\n[INFO] Cart is already empty.\n";
+                    s.out << "\n[INFO] Cart is already empty.\n";
                 }
-                pause();
+                pause(s);
             }
             else if (choice == 7) {
-                processCheckout();
+                processCheckout(s);
+            }
+            else if (choice == 8) {
+                showOrderHistory(s);
+            }
+            else if (choice == 9) {
+                advancedSearch(s);
             }
 
-        } while (choice != 8);
+        } while (choice != 10);
 
-        currentCustomerIdx = -1;
+        logoutCustomer(s);
+    }
+
+    // One receipt line, copied out so the receipt and ratings need no lock
+    struct OrderLine {
+        int pIdx;
+        string name;
+        double price; // Charged at the current price
+        int qty;
+        bool sold;
+    };
+
+    struct Receipt {
+        int orderId = 0; // 0 if nothing could be sold
+        time_t date;
+        vector<OrderLine> lines; // Empty if the cart was empty
+    };
+
+    // Checkout stages 1 + 2 for one customer: commits the cart's stock and saves the order.
+    // Shared by the menu and batch mode.
+    Receipt placeOrder(int customerIdx) {
+        METRIC_TIMER(CHECKOUT);
+        Receipt receipt;
+        receipt.date = time(0);
+        vector<OrderLine>& order = receipt.lines;
+
+        shared_lock<CatalogMutex> catalog(catalogLock);
+        lock_guard<StripeMutex> cartGuard(customerLock(customerIdx));
+        Customer& c = customers[customerIdx];
+
+        // Transfer items from Cart (Stack) to Checkout Line (Queue)
+        queue<CartItem> checkoutQueue;
+        c.cart.forEachNewestFirst([&](const CartItem& item) { checkoutQueue.push(item); });
+
+        // Process Queue
+        vector<int> sold;
+        while (!checkoutQueue.empty()) {
+            CartItem item = checkoutQueue.front();
+            checkoutQueue.pop();
+
+            int pIdx = findProduct(item.productId);
+            if (pIdx == -1) continue;
+            bool inStock = products.commit(pIdx, item.buyQty); // Deduct Stock
+            if (inStock) sold.push_back(pIdx);
+            else products.release(pIdx, item.buyQty);
+            order.push_back(OrderLine{pIdx, string(products.name(pIdx)), products.price[pIdx], item.buyQty, inStock});
+        }
+
+        if (!order.empty()) {
+            c.cart.clear();
+            c.unsaved = true;
+            auto stripes = lockProductStripes(sold); // Keeps each product's journal records in order
+            vector<string> records;
+            records.reserve(sold.size() + 2);
+            records.push_back(cartEntry(c));
+            for (int pIdx : sold) records.push_back(productEntry(pIdx));
+
+            // Order history: saved in the same group as the stock it took
+            if (!sold.empty()) {
+                Order placed;
+                placed.customerId = c.id;
+                placed.timestamp = receipt.date;
+                for (const OrderLine& line : order) {
+                    if (!line.sold) continue;
+                    placed.items.push_back(OrderItem{products.id[line.pIdx], line.qty, line.price});
+                    placed.total += line.price * line.qty;
+                }
+                lock_guard<mutex> ids(orderLock);
+                placed.id = receipt.orderId = orderCounter++;
+                string entry = OrderLog::format(placed);
+                records.push_back("O|" + entry);
+                journal.appendGroup(records, ORDERS_FILE, entry);
+            } else {
+                journal.appendGroup(records);
+            }
+            dirtyTables |= CARTS | PRODUCTS;
+        }
+        return receipt;
     }
 
     // FEATURE: CHECKOUT
     // DATA STRUCTURE: QUEUE
     // Reason: Simulates a checkout line (First In, First Out) processing of items.
-    void processCheckout() {
-        clearScreen();
-        Customer* c = &customers[currentCustomerIdx];
-        if (c->cartStack.empty()) {
-            cout << "\n[INFO] Cart is empty. Add items before checking out.\n";
-            pause();
+    // Logic: Runs in stages, so no stock or lock waits on the customer's typing:
+    //   1. Move the cart into the checkout line and commit each line's reserved stock (atomic, see ProductStore::commit)
+    //   2. Save the emptied cart and the new stock levels as one journal group (all or nothing after a crash)
+    //   3. Print the receipt
+    //   4. Ask for the ratings, then apply them together in one batch
+    void processCheckout(Session& s) {
+        clearScreen(s);
+        Receipt receipt = placeOrder(s.customerIdx); // Stages 1 + 2
+        const vector<OrderLine>& order = receipt.lines;
+        if (order.empty()) {
+            s.out << "\n[INFO] Cart is empty. Add items before checking out.\n";
+            pause(s);
             return;
         }
 
-        // Transfer items from Cart (Stack) to Checkout Line (Queue)
-        queue<CartItem> checkoutQueue;
-        while (!c->cartStack.empty()) {
-            checkoutQueue.push(c->cartStack.top());
-            c->cartStack.pop();
-        }
-
+        // Stage 3
         double total = 0;
-        printHeader("OFFICIAL RECEIPT");
+        printHeader(s, "OFFICIAL RECEIPT");
 
         // Timestamp
-        time_t now = time(0);
-        char* dt = ctime(&now);
-        cout << "Date: " << dt;
-        cout << "----------------------------------------\n";
+        if (receipt.orderId != 0) s.out << "Order #" << receipt.orderId << "\n";
+        s.out << "Date: " << timeText(receipt.date);
+        s.out << "----------------------------------------\n";
+        for (const OrderLine& line : order) {
+            if (line.sold) {
+                total += (line.price * line.qty);
+                s.out << left << setw(20) << line.name << " x " << line.qty << " = $" << (line.price * line.qty) << endl;
+            } else {
+                s.out << "[ERROR] Could not process " << line.name << ". Stock insufficient.\n";
+            }
+        }
+        s.out << "----------------------------------------\n";
+        s.out << "TOTAL PAID: $" << total << endl;
+        s.out << "----------------------------------------\n";
+        s.out << "Thank you for your purchase!\n";
 
-        // Process Queue
-        while (!checkoutQueue.empty()) {
-            CartItem item = checkoutQueue.front();
-            checkoutQueue.pop();
+        // Stage 4: RATING LOGIC (Fixed Range 1-5)
+        vector<pair<int, int>> ratings; // Product position, stars
+        for (const OrderLine& line : order) {
+            if (!line.sold) continue;
+            s.out << "   -> Rate " << line.name << " (1-5): ";
+            int r = 0;
+            while (true) {
+                if (s.in >> r && r >= 1 && r <= 5) break;
+                if (s.in.eof()) { r = 0; break; } // Session ended: the order stands, the rest go unrated
+                s.out << "      [Invalid] Please enter 1-5: ";
+                s.in.clear();
+                s.in.ignore(numeric_limits<streamsize>::max(), '\n');
+            }
+            if (r == 0) break;
+            ratings.emplace_back(line.pIdx, r);
+        }
+        rateProducts(ratings);
+        pause(s);
+    }
+
+    // FEATURE: ORDER HISTORY
+    // Logic: Streams orders.txt (see OrderLog::forEach), so memory use does not grow with the history.
+    void showOrderHistory(Session& s) {
+        clearScreen(s);
+        printHeader(s, "ORDER HISTORY");
+        int customerId;
+        {
+            shared_lock<CatalogMutex> catalog(catalogLock);
+            customerId = customers[s.customerIdx].id;
+        }
+        int shown = 0;
+        OrderLog::forEach(ORDERS_FILE, [&](const Order& o) {
+            if (o.customerId != customerId) return;
+            shown++;
+            s.out << "\nOrder #" << o.id << " - " << timeText(o.timestamp);
+            shared_lock<CatalogMutex> catalog(catalogLock); // Product names only
+            for (const auto& item : o.items) {
+                int pIdx = findProduct(item.productId);
+                s.out << "   " << left << setw(20) << (pIdx == -1 ? string_view("(removed)") : products.name(pIdx))
+                      << " x " << item.qty << " = $" << item.price * item.qty << "\n";
+            }
+            s.out << "   Total: $" << o.total << "\n";
+        });
+        if (shown == 0) s.out << "\n[INFO] No orders yet.\n";
+        pause(s);
+    }
+
+    // MAIN LOOP (one user, from the console or a socket)
+    void runSession(Session& s) {
+        int mainChoice;
+        try {
+            while (true) {
+                maybeCompact();
+                clearScreen(s);
+                printHeader(s, "ONLINE MARKETPLACE SYSTEM");
+                s.out << "1. Seller Menu\n";
+                s.out << "2. Customer Menu\n";
+                s.out << "3. Exit\n";
+                s.out << "----------------------------------------\n";
+                s.out << "Enter Choice: ";
+                mainChoice = getIntInput(s);
 
-            bool stockAvailable = false;
-            // Update live stock in Product Vector
-            for(auto &p : products) {
-                if(p.id == item.product.id) {
-                    if (p.quantity >= item.buyQty) {
-                        p.quantity -= item.buyQty; // Deduct Stock
-                        total += (item.product.price * item.buyQty);
-                        cout << left << setw(20) << item.product.name << " x " << item.buyQty << " = $" << (item.product.price * item.buyQty) << endl;
-                        stockAvailable = true;
-
-                        // RATING LOGIC (Fixed Range 1-5)
-                        cout << "   -> Rate " << p.name << " (1-5): ";
-                        int r;
-                        while (true) {
-                            if (cin >> r && r >= 1 && r <= 5) {
-                                p.addRating(r);
-                                break;
-                            } else {
-                                cout << "      [Invalid] Please enter 1-5: ";
-                                cin.clear();
-                                cin.ignore(numeric_limits<streamsize>::max(), '\n');
-                            }
-                        }
-
-                    } else {
-                        cout << "[ERROR] Could not process " << item.product.name << ". Stock insufficient.\n";
-                    }
-                    break;
+                if (mainChoice == 1) {
+                    clearScreen(s);
+                    int c;
+                    s.out << "\n1. Register New Seller\n2. Login\nChoice: ";
+                    c = getIntInput(s);
+                    if (c == 1) registerSeller(s);
+                    else if(loginSeller(s)) sellerMenu(s);
+                }
+                else if (mainChoice == 2) {
+                    clearScreen(s);
+                    int c;
+                    s.out << "\n1. Register New Customer\n2. Login\nChoice: ";
+                    c = getIntInput(s);
+                    if (c == 1) registerCustomer(s);
+                    else if(loginCustomer(s)) customerMenu(s);
                 }
+                else break;
             }
+        } catch (const SessionClosed&) {
+            // Input ended mid-menu: everything already done was journaled, so there is nothing to undo
+            if (s.customerIdx != -1) logoutCustomer(s); // Lets the customer's shard be evicted again
         }
-        cout << "----------------------------------------\n";
-        cout << "TOTAL PAID: $" << total << endl;
-        cout << "----------------------------------------\n";
-        cout << "Thank you for your purchase!\n";
-        saveData(); // Commit changes to files
-        pause();
+        s.out << flush;
     }
 
-    // MAIN LOOP
+    // Console mode: a single user on this terminal
     void run() {
-        int mainChoice;
-        while (true) {
-            clearScreen();
-            printHeader("ONLINE MARKETPLACE SYSTEM");
-            cout << "1. Seller Menu\n";
-            cout << "2. Customer Menu\n";
-            cout << "3. Exit\n";
-            cout << "----------------------------------------\n";
-            cout << "Enter Choice: ";
-            mainChoice = getIntInput();
-
-            if (mainChoice == 1) {
-                clearScreen();
-                int c;
-                cout << "\n1. Register New Seller\n2. Login\nChoice: ";
-                c = getIntInput();
-                if (c == 1) registerSeller();
-                else if(loginSeller()) sellerMenu();
-            }
-            else if (mainChoice == 2) {
-                clearScreen();
-                int c;
-                cout << "\n1. Register New Customer\n2. Login\nChoice: ";
-                c = getIntInput();
-                if (c == 1) registerCustomer();
-                else if(loginCustomer()) customerMenu();
-            }
-            else break;
+        Session console{cin, cout, true};
+        runSession(console);
+    }
+
+    // ==========================================
+    // 5. SERVER MODE
+    // ==========================================
+    // Many users at once over TCP (e.g. "nc localhost 5555"), one thread per connection.
+    // Every connection runs the same menus as the console, with its own Session.
+
+#ifndef _WIN32
+    static inline volatile sig_atomic_t stopRequested = 0;
+    static void requestStop(int) { stopRequested = 1; }
+
+    struct Client {
+        int fd;
+        thread worker;
+        atomic<bool> done{false};
+    };
+
+    // Accepts connections until SIGINT / SIGTERM, then disconnects every client and waits for them
+    bool serve(int port) {
+        int listener = socket(AF_INET, SOCK_STREAM, 0);
+        int yes = 1;
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons(port);
+        if (listener < 0 || ::bind(listener, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(listener, 64) < 0) {
+            cerr << "[ERROR] Cannot listen on port " << port << "\n";
+            if (listener >= 0) ::close(listener);
+            return false;
+        }
+        signal(SIGINT, requestStop);
+        signal(SIGTERM, requestStop);
+        signal(SIGPIPE, SIG_IGN); // A client hanging up must not kill the server
+        cout << "Serving on port " << port << " (Ctrl+C to stop)" << endl;
+
+        vector<unique_ptr<Client>> clients;
+        auto reap = [&](bool all) {
+            for (size_t i = 0; i < clients.size();) {
+                if (!all && !clients[i]->done) { i++; continue; }
+                clients[i]->worker.join();
+                ::close(clients[i]->fd); // Closed only after its session ended, so the fd is never reused under it
+                clients[i] = move(clients.back());
+                clients.pop_back();
+            }
+        };
+
+        while (!stopRequested) {
+            pollfd p{listener, POLLIN, 0};
+            if (poll(&p, 1, 200) > 0) { // Wakes up regularly to see stop requests
+                int fd = accept(listener, nullptr, nullptr);
+                if (fd >= 0) {
+                    auto client = make_unique<Client>();
+                    Client* cl = client.get();
+                    cl->fd = fd;
+                    cl->worker = thread([this, cl] {
+                        SocketBuf buf(cl->fd);
+                        iostream stream(&buf);
+                        Session session{stream, stream, false};
+                        runSession(session);
+                        cl->done = true;
+                    });
+                    clients.push_back(move(client));
+                }
+            }
+            reap(false);
+        }
+
+        ::close(listener);
+        for (auto& cl : clients) shutdown(cl->fd, SHUT_RDWR); // Sessions waiting on input see end of input and return
+        reap(true);
+        cout << "Server stopped." << endl;
+        return true;
+    }
+#else
+    bool serve(int) {
+        cerr << "[ERROR] Server mode is not available on this platform.\n";
+        return false;
+    }
+#endif
+
+    // ==========================================
+    // 6. BATCH MODE
+    // ==========================================
+    // Runs commands from a script instead of the menus: no screen clearing, no pauses, no prompts.
+    // One command per line, fields separated by '|' like the data files; blank lines and '#' comments are skipped.
+    //   seller|<name>|<email>
+    //   customer|<name>|<address>|<phone>|<email>
+    //   product|<seller id>|<name>|<category>|<price>|<quantity>
+    //   import|<seller id>|<file>   (see importProducts)
+    //   stats|<seller id>   (the seller's inventory and rating analytics)
+    //   cart|<customer id>|<product id>|<quantity>
+    //   checkout|<customer id>[|<stars 1-5, given to every item bought>]
+    //   query|<category>|<min price>|<max price>|<min rating>|<in stock y/n>|<sort: rating, price or price-desc>
+    //         (any field may be left empty; prints the match count and the first page of IDs)
+    //   metrics   (timings and counters so far; needs a -DMARKETPLACE_METRICS build)
+    // Prints one line per command. Returns false if any command failed.
+    bool runBatch(istream& in, ostream& out) {
+        string line;
+        vector<string_view> f;
+        int lineNo = 0, failed = 0;
+        while (getline(in, line)) {
+            lineNo++;
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (line.empty() || line[0] == '#') continue;
+            maybeCompact(); // As the menus do between actions
+            T::split(line, f);
+            if (!runCommand(f, out)) {
+                out << "  (line " << lineNo << ": " << line << ")\n";
+                failed++;
+            }
+        }
+        out << "[INFO] Batch finished: " << lineNo << " lines, " << failed << " failed.\n";
+        return failed == 0;
+    }
+
+    // Runs one batch command, given as its '|' fields
+    bool runCommand(const vector<string_view>& f, ostream& out) {
+        string_view cmd = f[0];
+        auto text = [&](int i) { return string(f[i]); };
+        int a = 0, b = 0, c = 0;
+        double price = 0;
+
+        if (cmd == "seller" && f.size() == 3) {
+            out << "[SUCCESS] Seller #" << createSeller(text(1), text(2)) << " registered.\n";
+            return true;
+        }
+        if (cmd == "customer" && f.size() == 5) {
+            out << "[SUCCESS] Customer #" << createCustomer(text(1), text(2), text(3), text(4)) << " registered.\n";
+            return true;
+        }
+        if (cmd == "product" && f.size() == 6 && T::toInt(f[1], a) && T::toDouble(f[4], price) && T::toInt(f[5], b)) {
+            int sellerIdx;
+            {
+                shared_lock<CatalogMutex> catalog(catalogLock);
+                sellerIdx = findSeller(a);
+            }
+            if (sellerIdx == -1) { out << "[ERROR] Seller ID not found.\n"; return false; }
+            if (price < 0 || b < 0) { out << "[ERROR] Price and quantity cannot be negative.\n"; return false; }
+            out << "[SUCCESS] Product #" << createProduct(sellerIdx, text(2), text(3), price, b) << " added.\n";
+            return true;
+        }
+        if (cmd == "import" && f.size() == 3 && T::toInt(f[1], a)) {
+            int sellerIdx;
+            {
+                shared_lock<CatalogMutex> catalog(catalogLock);
+                sellerIdx = findSeller(a);
+            }
+            if (sellerIdx == -1) { out << "[ERROR] Seller ID not found.\n"; return false; }
+            return importProducts(sellerIdx, text(2), out);
+        }
+        if (cmd == "stats" && f.size() == 2 && T::toInt(f[1], a)) {
+            int sellerIdx;
+            {
+                shared_lock<CatalogMutex> catalog(catalogLock);
+                sellerIdx = findSeller(a);
+            }
+            if (sellerIdx == -1) { out << "[ERROR] Seller ID not found.\n"; return false; }
+            ProductStore::Totals t = sellerTotals(sellerIdx);
+            out << "[SUCCESS] Seller #" << a << ": " << t.products << " product(s), " << t.units << " unit(s), value $"
+                << t.inventoryValue << ", rating " << t.averageRating() << " (" << t.ratingCount << " ratings), "
+                << t.lowStock << " low on stock, " << t.unrated << " unrated.\n";
+            return true;
+        }
+        if (cmd == "cart" && f.size() == 4 && T::toInt(f[1], a) && T::toInt(f[2], b) && T::toInt(f[3], c)) {
+            int customerIdx = batchCustomer(a, out);
+            return customerIdx != -1 && addToCart(customerIdx, b, c, out);
+        }
+        if (cmd == "checkout" && (f.size() == 2 || f.size() == 3) && T::toInt(f[1], a)
+            && (f.size() == 2 || (T::toInt(f[2], b) && b >= 1 && b <= 5))) {
+            int customerIdx = batchCustomer(a, out);
+            if (customerIdx == -1) return false;
+            Receipt receipt = placeOrder(customerIdx);
+            if (receipt.lines.empty()) { out << "[INFO] Cart is empty.\n"; return true; }
+
+            double total = 0;
+            int bought = 0, missing = 0;
+            vector<pair<int, int>> ratings;
+            for (const OrderLine& l : receipt.lines) {
+                if (!l.sold) { missing++; continue; }
+                bought++;
+                total += l.price * l.qty;
+                if (b != 0) ratings.emplace_back(l.pIdx, b);
+            }
+            rateProducts(ratings);
+            if (bought == 0) { out << "[ERROR] Could not process any item. Stock insufficient.\n"; return false; }
+            out << "[SUCCESS] Order #" << receipt.orderId << ": " << bought << " item(s), total $" << total;
+            if (missing > 0) out << " (" << missing << " item(s) out of stock)";
+            out << ".\n";
+            return true;
         }
+        if (cmd == "query" && f.size() == 7) {
+            ProductQuery q;
+            q.category = text(1);
+            bool valid = (f[2].empty() || T::toDouble(f[2], q.minPrice)) && (f[3].empty() || T::toDouble(f[3], q.maxPrice))
+                         && (f[4].empty() || T::toDouble(f[4], q.minRating));
+            q.inStockOnly = f[5] == "y";
+            if (f[6] == "price") q.sort = ProductQuery::PRICE_LOW_HIGH;
+            else if (f[6] == "price-desc") q.sort = ProductQuery::PRICE_HIGH_LOW;
+            else if (!f[6].empty() && f[6] != "rating") valid = false;
+            if (!valid) { out << "[ERROR] Invalid price, rating or sort order.\n"; return false; }
+
+            ResultCache::Rows matches = queryListing(q);
+            shared_lock<CatalogMutex> catalog(catalogLock);
+            out << "[SUCCESS] " << matches->rows.size() << " match(es)";
+            for (size_t i = 0; i < matches->ranked && i < PAGE_SIZE; i++) out << " " << products.id[matches->rows[i]];
+            out << "\n";
+            return true;
+        }
+        if (cmd == "metrics" && f.size() == 1) {
+#ifdef MARKETPLACE_METRICS
+            Metrics::dump(out);
+            return true;
+#else
+            out << "[ERROR] Metrics are not compiled in (build with -DMARKETPLACE_METRICS).\n";
+            return false;
+#endif
+        }
+        out << "[ERROR] Unknown command or wrong fields.\n";
+        return false;
+    }
+
+    // Position of a customer named by id in a batch command, or -1 (reported to 'out')
+    // Note: The customer is not pinned, so the position is only good until another shard is loaded (which
+    // may evict this one). Batch mode runs one command at a time, so that never happens mid-command.
+    int batchCustomer(int id, ostream& out) {
+        int idx;
+        {
+            shared_lock<CatalogMutex> catalog(catalogLock);
+            idx = findCustomer(id);
+        }
+        if (idx == -1) {
+            unique_lock<CatalogMutex> catalog(catalogLock); // Not resident: load its shard
+            idx = loadCustomer(id);
+        }
+        if (idx == -1) out << "[ERROR] Customer ID not found.\n";
+        return idx;
     }
 };
 
 // ==========================================
-// 5. MAIN EXECUTION
+// 7. MAIN EXECUTION
 // ==========================================
-int main() {
-    Marketplace system;
-    system.run();
+// MARKETPLACE_NO_MAIN: lets another program (benchmark.cpp) include this file and drive Marketplace itself
+#ifndef MARKETPLACE_NO_MAIN
+int main(int argc, char* argv[]) {
+    int flushIntervalMs = Marketplace::DEFAULT_FLUSH_INTERVAL_MS;
+    int port = 0;
+    string mode, script;
+    for (int i = 1; i < argc; i++) {
+        string option = argv[i];
+        if (option == "--flush-ms" && i + 1 < argc) flushIntervalMs = atoi(argv[++i]);
+        else if (option == "--serve" && i + 1 < argc) { mode = option; port = atoi(argv[++i]); }
+        else if (option == "--to-binary" || option == "--to-text") mode = option;
+        else if (option == "--batch") {
+            mode = option;
+            if (i + 1 < argc && argv[i + 1][0] != '-') script = argv[++i]; // No file: read commands from stdin
+        }
+        else {
+            cerr << "Usage: " << argv[0] << " [--flush-ms <milliseconds>]"
+                 << " [--serve <port> | --batch [<command file>] | --to-binary | --to-text]\n";
+            return 1;
+        }
+    }
+
+    ifstream scriptFile;
+    if (!script.empty()) {
+        scriptFile.open(script);
+        if (!scriptFile) {
+            cerr << "[ERROR] Cannot open " << script << "\n";
+            return 1;
+        }
+    }
+
+    Marketplace system(flushIntervalMs);
+
+    // FORMAT CONVERTER: switch the data files between the text and binary formats
+    if (mode == "--to-binary") system.convertToBinary();
+    else if (mode == "--to-text") return system.convertToText() ? 0 : 1;
+    else if (mode == "--serve") return system.serve(port) ? 0 : 1;
+    else if (mode == "--batch") return system.runBatch(script.empty() ? cin : scriptFile, cout) ? 0 : 1;
+    else system.run();
     return 0;
 
 }
 
+#endif
@@ -0,0 +1,290 @@
+// ==========================================
+// MARKETPLACE LOAD TEST
+// ==========================================
+// Replays shopper sessions from many threads at once against one Marketplace on synthetic data (see
+// benchmark.cpp). Each session does what the customer menu does: log in, browse the top-rated pages,
+// search, add Zipf-popular products to the cart, sometimes undo the last add, check out (rating what
+// was bought) or walk away, and log out. Reports throughput, latency percentiles per operation and
+// lock contention, for sizing hardware and checking how the locking scales.
+//
+// Build: g++ -std=c++17 -O2 -pthread loadtest.cpp -o loadtest
+// Usage: loadtest [--threads N] [--seconds S] [--skew S] [--sellers N] [--customers N] [--products N]
+//
+// Note: Always built with MARKETPLACE_METRICS: the contention numbers come from the instrumented locks
+// (see Metrics::Contended), and the Marketplace prints its own timings to stderr when it shuts down.
+
+#define MARKETPLACE_METRICS
+#define BENCHMARK_NO_MAIN
+#include "benchmark.cpp"
+
+namespace {
+
+// ==========================================
+// 1. CONFIGURATION
+// ==========================================
+
+struct LoadConfig {
+    int threads = 8;    // Concurrent shoppers
+    double seconds = 10;
+    double skew = 1.0;  // Zipf exponent of product popularity (0 = uniform)
+    BenchConfig data;   // Size of the synthetic marketplace
+};
+
+// The steps of a shopper session
+enum Operation { LOGIN, TOP_RATED, SEARCH, ADD_TO_CART, UNDO, CHECKOUT, LOGOUT, OPERATION_COUNT };
+const char* const OPERATION_NAMES[OPERATION_COUNT] = {
+    "login", "top_rated", "search", "add_to_cart", "undo", "checkout", "logout"
+};
+
+const char* const SEARCHES[] = { "phone", "sony lap", "speaker 1", "Apple*", "watch 99", "usb", "Dell*", "kettle" };
+
+// ==========================================
+// 2. PER-THREAD RESULTS
+// ==========================================
+
+// Latencies and outcomes of one shopper thread, in the log-linear buckets of Metrics
+// Logic: Every thread records into its own copy and the copies are added up after the run,
+// so recording takes no lock and shares no cache line.
+struct ShopperStats {
+    vector<uint64_t> buckets[OPERATION_COUNT];
+    uint64_t totalNs[OPERATION_COUNT] = {};
+    uint64_t maxNs[OPERATION_COUNT] = {};
+    long long sessions = 0;
+    long long refusedAdds = 0;    // addToCart turned down (not enough stock)
+    long long emptyCheckouts = 0; // Nothing left to sell at checkout
+
+    ShopperStats() {
+        for (auto& b : buckets) b.assign(Metrics::BUCKETS, 0);
+    }
+
+    void record(Operation op, uint64_t ns) {
+        buckets[op][Metrics::bucketOf(ns)]++;
+        totalNs[op] += ns;
+        maxNs[op] = max(maxNs[op], ns);
+    }
+
+    void add(const ShopperStats& other) {
+        for (int op = 0; op < OPERATION_COUNT; op++) {
+            for (int b = 0; b < Metrics::BUCKETS; b++) buckets[op][b] += other.buckets[op][b];
+            totalNs[op] += other.totalNs[op];
+            maxNs[op] = max(maxNs[op], other.maxNs[op]);
+        }
+        sessions += other.sessions;
+        refusedAdds += other.refusedAdds;
+        emptyCheckouts += other.emptyCheckouts;
+    }
+
+    uint64_t count(int op) const {
+        uint64_t n = 0;
+        for (uint64_t c : buckets[op]) n += c;
+        return n;
+    }
+
+    // Value at quantile q (0-1), to within its bucket (see Metrics::percentile)
+    uint64_t percentile(int op, double q) const {
+        uint64_t rank = max<uint64_t>(1, uint64_t(q * count(op) + 0.5)), seen = 0;
+        for (int b = 0; b < Metrics::BUCKETS; b++)
+            if ((seen += buckets[op][b]) >= rank) return min(Metrics::bucketTop(b), maxNs[op]);
+        return maxNs[op];
+    }
+};
+
+// Runs f() and records how long it took as one 'op'; returns f's result
+template <typename F>
+auto timed(ShopperStats& stats, Operation op, F f) {
+    auto start = chrono::steady_clock::now();
+    auto result = f();
+    stats.record(op, chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count());
+    return result;
+}
+
+// ==========================================
+// 3. SHOPPER SESSIONS
+// ==========================================
+
+// One shopper, start to finish. Calls maybeCompact() between steps, as the menus do.
+void shop(Marketplace& m, const LoadConfig& cfg, const Zipf& popularity, mt19937& rng, ShopperStats& stats) {
+    istringstream in;
+    ostringstream out; // Messages are discarded: only their cost counts
+    Session s{in, out, false};
+
+    string email = customerEmail(1 + rng() % cfg.data.customers);
+    if (!timed(stats, LOGIN, [&] { return m.loginByEmail(s, email); })) return;
+    m.maybeCompact();
+
+    // Browse one to three screens of the rating ranking
+    RatingIndex::Entry cursor = RatingIndex::start();
+    vector<int> rows;
+    for (int page = 1 + rng() % 3; page > 0; page--) {
+        rows.clear();
+        if (!timed(stats, TOP_RATED, [&] { return m.topRatedPage(cursor, rows); })) break;
+    }
+
+    string query = SEARCHES[rng() % countOf(SEARCHES)];
+    timed(stats, SEARCH, [&] { return m.searchProducts(query).size(); });
+
+    // One to five adds, picked by popularity
+    for (int items = 1 + rng() % 5; items > 0; items--) {
+        int pid = 1 + popularity(rng), qty = 1 + rng() % 2;
+        if (!timed(stats, ADD_TO_CART, [&] { return m.addToCart(s.customerIdx, pid, qty, out); })) stats.refusedAdds++;
+        m.maybeCompact();
+    }
+
+    // One shopper in four takes the last item back out
+    if (rng() % 4 == 0) timed(stats, UNDO, [&] { return m.removeFromCart(s.customerIdx, 0); });
+
+    // Seven in ten check out and rate everything they bought; the rest leave their cart for later
+    if (rng() % 10 < 7) {
+        int orderId = timed(stats, CHECKOUT, [&] {
+            Marketplace::Receipt receipt = m.placeOrder(s.customerIdx);
+            vector<pair<int, int>> ratings;
+            for (const auto& line : receipt.lines)
+                if (line.sold) ratings.emplace_back(line.pIdx, 1 + rng() % 5);
+            m.rateProducts(ratings);
+            return receipt.orderId;
+        });
+        if (orderId == 0) stats.emptyCheckouts++;
+        m.maybeCompact();
+    }
+
+    timed(stats, LOGOUT, [&] {
+        m.logoutCustomer(s);
+        return 0;
+    });
+    stats.sessions++;
+}
+
+// ==========================================
+// 4. RUN & REPORT
+// ==========================================
+
+// The metrics recorded between two Metrics::collect() blocks. Give it back with Metrics::release().
+// Logic: Counts, sums and histogram buckets subtract exactly. A maximum does not, so the run's maximum is
+// the top of its highest non-empty bucket (capped by the overall maximum), like a percentile.
+Metrics::Block* difference(const Metrics::Block& after, const Metrics::Block& before) {
+    Metrics::Block* run = new (malloc(sizeof(Metrics::Block))) Metrics::Block();
+    for (int t = 0; t < Metrics::TIMER_COUNT; t++) {
+        for (int b = 0; b < Metrics::BUCKETS; b++) {
+            uint64_t n = after.buckets[t][b].load() - before.buckets[t][b].load();
+            run->buckets[t][b] = n;
+            if (n > 0) run->maxNs[t] = min(Metrics::bucketTop(b), after.maxNs[t].load());
+        }
+        run->totalNs[t] = after.totalNs[t].load() - before.totalNs[t].load();
+    }
+    for (int c = 0; c < Metrics::COUNTER_COUNT; c++) run->counters[c] = after.counters[c].load() - before.counters[c].load();
+    return run;
+}
+
+void report(const LoadConfig& cfg, const ShopperStats& total, double elapsed, const Metrics::Block& run) {
+    auto d = [](uint64_t ns) { return Metrics::duration(ns); };
+    cout << string(96, '-') << "\n";
+    cout << left << setw(14) << "Operation" << right << setw(12) << "Count" << setw(12) << "Ops/s" << setw(11) << "Mean"
+         << setw(11) << "p50" << setw(11) << "p99" << setw(11) << "p99.9" << setw(11) << "Max" << "\n";
+    cout << string(96, '-') << "\n";
+    long long operations = 0;
+    for (int op = 0; op < OPERATION_COUNT; op++) {
+        uint64_t n = total.count(op);
+        operations += n;
+        if (n == 0) continue;
+        cout << left << setw(14) << OPERATION_NAMES[op] << right << setw(12) << n << setw(12) << fixed << setprecision(0) << n / elapsed
+             << setw(11) << d(total.totalNs[op] / n) << setw(11) << d(total.percentile(op, 0.5))
+             << setw(11) << d(total.percentile(op, 0.99)) << setw(11) << d(total.percentile(op, 0.999))
+             << setw(11) << d(total.maxNs[op]) << "\n";
+    }
+    cout << string(96, '-') << "\n";
+    cout << setprecision(1) << "Sessions: " << total.sessions << " (" << total.sessions / elapsed << "/s), operations: "
+         << operations << " (" << operations / elapsed << "/s), " << cfg.threads << " threads\n";
+    cout << "Adds refused (stock): " << total.refusedAdds << ", checkouts with nothing sold: " << total.emptyCheckouts << "\n";
+
+    // Contention during the run: how often taking each lock meant waiting, and for how long
+    struct LockRow { const char* name; Metrics::Timer wait; Metrics::Counter taken; };
+    const LockRow locks[] = {
+        { "catalog", Metrics::CATALOG_WAIT, Metrics::CATALOG_LOCKS },
+        { "row stripes", Metrics::STRIPE_WAIT, Metrics::STRIPE_LOCKS },
+        { "rating", Metrics::RATING_WAIT, Metrics::RATING_LOCKS },
+    };
+    cout << "\n" << left << setw(14) << "Lock" << right << setw(12) << "Acquired" << setw(12) << "Waited" << setw(11) << "Waited %"
+         << setw(11) << "Mean wait" << setw(11) << "p99 wait" << setw(11) << "Max wait" << setw(13) << "Total wait" << "\n";
+    cout << string(96, '-') << "\n";
+    for (const LockRow& l : locks) {
+        uint64_t taken = run.counters[l.taken].load();
+        uint64_t waited = Metrics::count(run, l.wait);
+        uint64_t waitNs = run.totalNs[l.wait].load();
+        cout << left << setw(14) << l.name << right << setw(12) << taken << setw(12) << waited
+             << setw(10) << setprecision(2) << (taken == 0 ? 0.0 : 100.0 * waited / taken) << "%"
+             << setw(11) << d(waited == 0 ? 0 : waitNs / waited) << setw(11) << d(Metrics::percentile(run, l.wait, 0.99))
+             << setw(11) << d(run.maxNs[l.wait].load()) << setw(13) << d(waitNs) << "\n";
+    }
+    cout << string(96, '-') << "\n";
+    cout << "Stock reservation retries (lost compare-and-swap races, lock-free): "
+         << run.counters[Metrics::STOCK_RETRIES].load() << "\n";
+}
+
+void runLoad(const LoadConfig& cfg) {
+    Zipf popularity(cfg.data.products, cfg.skew);
+    generateData(cfg.data, popularity);
+    cout << "Data: " << cfg.data.sellers << " sellers, " << cfg.data.customers << " customers, " << cfg.data.products
+         << " products; popularity Zipf skew " << cfg.skew << "\n";
+
+    Marketplace m;
+    cout << "Running " << cfg.threads << " shopper threads for " << cfg.seconds << " s...\n";
+
+    vector<ShopperStats> stats(cfg.threads);
+    atomic<bool> stop{false};
+    Metrics::Block* before = Metrics::collect(); // Loading took locks too: only the run's share is reported
+    auto start = chrono::steady_clock::now();
+    vector<thread> shoppers;
+    for (int t = 0; t < cfg.threads; t++) {
+        shoppers.emplace_back([&, t] {
+            mt19937 rng(1000 + t); // Fixed seeds: runs with the same settings replay the same sessions
+            while (!stop.load(memory_order_relaxed)) shop(m, cfg, popularity, rng, stats[t]);
+        });
+    }
+    this_thread::sleep_for(chrono::duration<double>(cfg.seconds));
+    stop = true;
+    for (thread& t : shoppers) t.join();
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    Metrics::Block* after = Metrics::collect();
+    Metrics::Block* run = difference(*after, *before);
+
+    ShopperStats total;
+    for (const ShopperStats& s : stats) total.add(s);
+    report(cfg, total, elapsed, *run);
+    Metrics::release(before);
+    Metrics::release(after);
+    Metrics::release(run);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    LoadConfig cfg;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--threads" && hasValue) cfg.threads = max(1, atoi(argv[++i]));
+        else if (arg == "--seconds" && hasValue) cfg.seconds = max(0.1, atof(argv[++i]));
+        else if (arg == "--skew" && hasValue) cfg.skew = max(0.0, atof(argv[++i]));
+        else if (arg == "--sellers" && hasValue) cfg.data.sellers = max(1, atoi(argv[++i]));
+        else if (arg == "--customers" && hasValue) cfg.data.customers = max(1, atoi(argv[++i]));
+        else if (arg == "--products" && hasValue) cfg.data.products = max(1, atoi(argv[++i]));
+        else {
+            cerr << "Usage: " << argv[0] << " [--threads N] [--seconds S] [--skew S]"
+                 << " [--sellers N] [--customers N] [--products N]\n";
+            return 1;
+        }
+    }
+
+    // Scratch directory: the marketplace reads and writes its files relative to the working directory
+    namespace fs = std::filesystem;
+    fs::path home = fs::current_path();
+    fs::path scratch = fs::temp_directory_path() / ("marketplace-load-" + to_string(getpid()));
+    fs::create_directories(scratch);
+    fs::current_path(scratch);
+
+    runLoad(cfg);
+
+    fs::current_path(home);
+    fs::remove_all(scratch);
+    return 0;
+}